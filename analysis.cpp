@@ -0,0 +1,243 @@
+#include "analysis.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+using namespace std;
+
+/**Type Definitions********************************************************************************************************************/
+
+typedef struct Store
+{
+	uint16_t at, first, last;	//instruction, written range
+} Store;
+
+
+uint16_t opcodeAt(const Analysis& a, uint16_t address)
+{
+	return a.ram[address & 0x0FFF] << 8 | a.ram[(address + 1) & 0x0FFF];
+}
+
+
+void markRange(Analysis& a, uint16_t first, int count, uint8_t flag)
+{
+	for (int i = 0; i < count; ++i) a.map[(first + i) & 0x0FFF] |= flag;
+}
+
+
+//follow every path, I along with it (a second visit with a different I makes it unknown)
+void trace(Analysis& a, vector<Store>& stores)
+{
+	vector<uint16_t> iAt(4096, I_UNVISITED);
+	vector<pair<uint16_t, uint16_t> > work;	//address, I
+	work.push_back(make_pair((uint16_t)OFFSET_ROM, (uint16_t)I_UNKNOWN));
+	a.map[OFFSET_ROM] |= BYTE_LEADER | BYTE_FUNCTION;
+
+	while (!work.empty())
+	{
+		uint16_t address = work.back().first, index = work.back().second;
+		work.pop_back();
+		if (address > 0x0FFE) continue;
+		if (iAt[address] == index || iAt[address] == I_UNKNOWN) continue; //nothing new
+		index = iAt[address] == I_UNVISITED ? index : (uint16_t)I_UNKNOWN;
+		iAt[address] = index;
+
+		uint16_t op = opcodeAt(a, address);
+		uint8_t kind = opcodeClass(op);
+		if (kind == OP_INVALID)
+		{
+			a.invalid.push_back(address);
+			continue;
+		}
+		a.map[address] |= BYTE_START;
+		markRange(a, address, 2, BYTE_CODE);
+
+		int x = (op & 0x0F00) >> 8, n = op & 0x000F, nn = op & 0x00FF;
+		uint16_t nnn = op & 0x0FFF, next = address + 2;
+		bool known = index != I_UNKNOWN;
+
+		switch (kind)
+		{
+		case OP_RETURN:
+			continue;
+		case OP_CALL:
+			a.map[nnn] |= BYTE_LEADER | BYTE_FUNCTION;
+			a.map[next & 0x0FFF] |= BYTE_LEADER;
+			work.push_back(make_pair(nnn, (uint16_t)I_UNKNOWN));
+			work.push_back(make_pair(next, (uint16_t)I_UNKNOWN)); //callee may change I
+			continue;
+		case OP_JUMP:
+			a.map[nnn] |= BYTE_LEADER;
+			if (nnn != address) work.push_back(make_pair(nnn, index));
+			continue;
+		case OP_INDIRECT:
+			a.indirect.push_back(address);
+			continue;
+		}
+
+		switch (op >> 12)
+		{
+		case 0xA:
+			index = nnn;
+			break;
+		case 0xD:
+			if (known) markRange(a, index, n, BYTE_SPRITE); //N rows, DXY0 reads nothing (draw() runs 0 rows)
+			break;
+		case 0xF:
+			if (nn == 0x1E || nn == 0x29) index = I_UNKNOWN;
+			if (nn == 0x33 && known) stores.push_back({ address, index, (uint16_t)(index + 2) });
+			if (nn == 0x55 && known) stores.push_back({ address, index, (uint16_t)(index + x) });
+			if (nn == 0x65 && known) markRange(a, index, x + 1, BYTE_LOAD);
+			if (op == 0xF002 && known) markRange(a, index, AUDIO_PATTERN_BYTES, BYTE_LOAD);
+			//COSMACVIP moves I past the block
+			if ((nn == 0x55 || nn == 0x65) && known) index = I_UNKNOWN;
+			break;
+		default:
+			break;
+		}
+
+		if (kind == OP_SKIP)
+		{
+			a.map[next & 0x0FFF] |= BYTE_LEADER;
+			a.map[(next + 2) & 0x0FFF] |= BYTE_LEADER;
+			work.push_back(make_pair((uint16_t)(next + 2), index));
+		}
+		work.push_back(make_pair(next, index));
+	}
+}
+
+
+//cut the reached instructions into basic blocks
+void buildBlocks(Analysis& a)
+{
+	for (int address = 0; address < 4096; ++address)
+	{
+		if (!(a.map[address] & BYTE_START) || !(a.map[address] & BYTE_LEADER)) continue;
+
+		Block block;
+		block.start = (uint16_t)address;
+		block.call = 0;
+		block.function = -1;
+		uint16_t at = block.start;
+		for (;;)
+		{
+			uint16_t op = opcodeAt(a, at), nnn = op & 0x0FFF, next = at + 2;
+			uint8_t kind = opcodeClass(op);
+			block.end = next;
+			if (kind == OP_RETURN) { block.kind = END_RETURN; break; }
+			if (kind == OP_CALL)
+			{
+				block.kind = END_CALL;
+				block.call = nnn;
+				block.successors.push_back(next);
+				break;
+			}
+			if (kind == OP_JUMP)
+			{
+				block.kind = nnn == at ? END_HALT : END_JUMP;
+				if (nnn != at) block.successors.push_back(nnn);
+				break;
+			}
+			if (kind == OP_INDIRECT) { block.kind = END_INDIRECT; break; }
+			if (kind == OP_SKIP)
+			{
+				block.kind = END_SKIP;
+				block.successors.push_back(next);
+				block.successors.push_back(next + 2);
+				break;
+			}
+			if (next > 0x0FFE) { block.kind = END_ROM; break; }
+			if (!(a.map[next] & BYTE_START)) { block.kind = END_INVALID; break; }
+			if (a.map[next] & BYTE_LEADER)
+			{
+				block.kind = END_FALL;
+				block.successors.push_back(next);
+				break;
+			}
+			at = next;
+		}
+		a.blocks.push_back(block);
+	}
+
+	//instructions starting in the middle of another one
+	for (int address = 0; address < 4095; ++address)
+		if ((a.map[address] & BYTE_START) && (a.map[address + 1] & BYTE_START)) a.overlapping.push_back((uint16_t)(address + 1));
+}
+
+
+int blockAt(const Analysis& a, uint16_t start)
+{
+	//blocks are sorted by start
+	int low = 0, high = (int)a.blocks.size() - 1;
+	while (low <= high)
+	{
+		int mid = (low + high) / 2;
+		if (a.blocks[mid].start == start) return mid;
+		if (a.blocks[mid].start < start) low = mid + 1;
+		else high = mid - 1;
+	}
+	return -1;
+}
+
+
+//functions own the blocks reachable from their entry without entering calls (first owner wins)
+void buildCallGraph(Analysis& a)
+{
+	for (int address = 0; address < 4096; ++address)
+		if ((a.map[address] & BYTE_FUNCTION) && (a.map[address] & BYTE_START)) a.functions.push_back((uint16_t)address);
+	//entry point first
+	vector<uint16_t>::iterator entry = find(a.functions.begin(), a.functions.end(), (uint16_t)OFFSET_ROM);
+	if (entry != a.functions.end()) rotate(a.functions.begin(), entry, entry + 1);
+	a.calls.resize(a.functions.size());
+
+	for (size_t f = 0; f < a.functions.size(); ++f)
+	{
+		vector<int> work(1, blockAt(a, a.functions[f]));
+		while (!work.empty())
+		{
+			int b = work.back();
+			work.pop_back();
+			if (b < 0 || a.blocks[b].function >= 0) continue;
+			Block& block = a.blocks[b];
+			block.function = (int)f;
+			if (block.kind == END_CALL && find(a.calls[f].begin(), a.calls[f].end(), block.call) == a.calls[f].end()) a.calls[f].push_back(block.call);
+			for (size_t s = 0; s < block.successors.size(); ++s) work.push_back(blockAt(a, block.successors[s]));
+		}
+	}
+}
+
+
+bool analyzeRom(const uint8_t* rom, size_t size, Analysis& a)
+{
+	memset(a.ram, 0, sizeof(a.ram));
+	memset(a.map, 0, sizeof(a.map));
+	a.size = size < MAX_ROM_SIZE ? size : MAX_ROM_SIZE;
+	memcpy(a.ram + OFFSET_ROM, rom, a.size);
+
+	vector<Store> stores;
+	trace(a, stores);
+	for (size_t s = 0; s < stores.size(); ++s)
+	{
+		markRange(a, stores[s].first, stores[s].last - stores[s].first + 1, BYTE_STORE);
+		for (uint16_t i = stores[s].first; i <= stores[s].last; ++i)
+			if (a.map[i & 0x0FFF] & BYTE_CODE)
+			{
+				a.selfModifying.push_back(stores[s].at);
+				break;
+			}
+	}
+	buildBlocks(a);
+	buildCallGraph(a);
+	return true;
+}
+
+
+bool analyze(const char* filename, Analysis& a)
+{
+	FILE* file = fopen(filename, "rb");
+	if (!file) return false;
+	uint8_t rom[MAX_ROM_SIZE];
+	size_t size = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+	return analyzeRom(rom, size, a);
+}
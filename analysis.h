@@ -0,0 +1,69 @@
+#pragma once
+
+/*
+* Static analysis of a rom, no emulation, shared by analyze and checks.
+* Code is found by following the control flow from OFFSET_ROM the way decodeandexecute() runs it
+* (opcodeClass() of chip8.h, 0NNN is a call there, like 2NNN). I is tracked along the paths (ANNN),
+* so DXYN/FX65 mark the bytes they read as data, FX33/FX55 stores are checked against code (self modifying).
+* BNNN targets depend on V0 and are only flagged.
+*/
+
+#include "chip8.h"
+#include <vector>
+
+/*MACRO definitions**************************************************************************************************************************/
+
+/*byte map*/
+#define BYTE_CODE		0x01	//part of a reached instruction
+#define BYTE_START		0x02	//first byte of a reached instruction
+#define BYTE_SPRITE		0x04	//read by DXYN
+#define BYTE_LOAD		0x08	//read by FX65
+#define BYTE_STORE		0x10	//written by FX33/FX55
+#define BYTE_LEADER		0x20	//first instruction of a basic block
+#define BYTE_FUNCTION	0x40	//entry point or call target
+
+/*I tracking*/
+#define I_UNVISITED		0xFFFF
+#define I_UNKNOWN		0xFFFE
+
+/*how a basic block ends*/
+#define END_FALL		0	//into the next block (a leader follows)
+#define END_JUMP		1	//1NNN
+#define END_CALL		2	//2NNN/0NNN, continues after the call
+#define END_SKIP		3	//3XNN 4XNN 5XYN 9XYN EX9E EXA1, two successors
+#define END_RETURN		4	//00EE
+#define END_INDIRECT	5	//BNNN, targets unknown
+#define END_HALT		6	//1NNN to itself
+#define END_INVALID		7	//not an instruction, stops the path
+#define END_ROM			8	//ran off the end of ram
+
+/**Type Definitions********************************************************************************************************************/
+
+typedef struct Block
+{
+	uint16_t start, end;	//end: address after the last instruction
+	int kind;				//END_*
+	std::vector<uint16_t> successors;
+	uint16_t call;			//END_CALL: callee
+	int function;			//owning function, -1 if none
+} Block;
+
+typedef struct Analysis
+{
+	uint8_t ram[4096];
+	size_t size;			//rom bytes at OFFSET_ROM
+	uint8_t map[4096];		//BYTE_* per address
+	std::vector<Block> blocks;
+	std::vector<uint16_t> functions;			//entries, first is OFFSET_ROM
+	std::vector<std::vector<uint16_t> > calls;	//callees per function
+	std::vector<uint16_t> selfModifying;		//FX33/FX55 writing code
+	std::vector<uint16_t> indirect;			//BNNN
+	std::vector<uint16_t> invalid;			//paths that hit a non instruction
+	std::vector<uint16_t> overlapping;		//instruction starts inside another instruction
+} Analysis;
+
+/*Functions***************************************************************************************************/
+uint16_t opcodeAt(const Analysis& a, uint16_t address);	//instruction at address of the analysed ram
+bool analyzeRom(const uint8_t* rom, size_t size, Analysis& a);	//rom at OFFSET_ROM: code, blocks, functions, data, flags
+bool analyze(const char* filename, Analysis& a);	//analyzeRom() of a file, false if it cannot be read
+int blockAt(const Analysis& a, uint16_t start);		//index of the block starting at start, -1 if none
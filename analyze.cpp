@@ -0,0 +1,163 @@
+/*
+* analyze: static analysis of a rom, no emulation (analysis.h).
+* usage: analyze <rom>                : disassembly with blocks, functions, data and flags
+*        analyze --json <rom>         : control flow graph as JSON
+*        analyze --summary <rom> ...  : one line per rom (corpus scan)
+*/
+
+#include "analysis.h"
+#include "disasm.h"
+#include <stdio.h>
+#include <string.h>
+#include <chrono>
+#include <algorithm>
+
+using namespace std;
+
+
+const char* dataKind(uint8_t flags)
+{
+	if (flags & BYTE_SPRITE) return "sprite";
+	if (flags & BYTE_LOAD) return "load";
+	if (flags & BYTE_STORE) return "store";
+	return NULL;
+}
+
+
+void printListing(const char* filename, const Analysis& a)
+{
+	printf("; %s, %zu bytes, %zu blocks, %zu functions\n", filename, a.size, a.blocks.size(), a.functions.size());
+	uint16_t end = (uint16_t)(OFFSET_ROM + a.size);
+	for (uint16_t address = OFFSET_ROM; address < end;)
+	{
+		uint8_t flags = a.map[address];
+		if (flags & BYTE_START)
+		{
+			if (flags & BYTE_FUNCTION) printf("\nF_%03X:\n", address);
+			else if (flags & BYTE_LEADER) printf("L_%03X:\n", address);
+			uint16_t op = opcodeAt(a, address);
+			char text[32];
+			disassemble(op, text, sizeof(text));
+			printf("  %03X  %04X  %-18s", address, op, text);
+			if (find(a.selfModifying.begin(), a.selfModifying.end(), address) != a.selfModifying.end()) printf(" ; writes code");
+			if ((op >> 12) == 0xB) printf(" ; indirect jump");
+			if (flags & (BYTE_STORE | BYTE_SPRITE | BYTE_LOAD)) printf(" ; also %s data", dataKind(flags) ? dataKind(flags) : "");
+			printf("\n");
+			address += 2;
+			continue;
+		}
+
+		//data: up to 8 bytes per line, same kind, until the next instruction
+		const char* kind = dataKind(flags);
+		printf("  %03X  ", address);
+		int count = 0;
+		do
+		{
+			printf("%02X ", a.ram[address]);
+			++address;
+			++count;
+		} while (address < end && count < 8 && !(a.map[address] & BYTE_START) && dataKind(a.map[address]) == kind);
+		printf("%*s; %s\n", (8 - count) * 3, "", kind ? kind : (flags & BYTE_CODE) ? "inside instruction" : "unreached");
+	}
+}
+
+
+void printJSON(const char* filename, const Analysis& a)
+{
+	const char* kinds[9] = { "fall", "jump", "call", "skip", "return", "indirect", "halt", "invalid", "end" };
+	printf("{\n  \"rom\": \"");
+	for (const char* c = filename; *c; ++c) printf(*c == '"' || *c == '\\' ? "\\%c" : "%c", *c);
+	printf("\",\n  \"size\": %zu,\n  \"entry\": %d,\n", a.size, OFFSET_ROM);
+
+	printf("  \"blocks\": [\n");
+	for (size_t b = 0; b < a.blocks.size(); ++b)
+	{
+		const Block& block = a.blocks[b];
+		printf("    {\"start\": %d, \"end\": %d, \"kind\": \"%s\", \"function\": %d, \"successors\": [", block.start, block.end, kinds[block.kind], block.function);
+		for (size_t s = 0; s < block.successors.size(); ++s) printf("%s%d", s ? ", " : "", block.successors[s]);
+		printf("]");
+		if (block.kind == END_CALL) printf(", \"call\": %d", block.call);
+		printf("}%s\n", b + 1 < a.blocks.size() ? "," : "");
+	}
+	printf("  ],\n  \"functions\": [\n");
+	for (size_t f = 0; f < a.functions.size(); ++f)
+	{
+		printf("    {\"entry\": %d, \"calls\": [", a.functions[f]);
+		for (size_t c = 0; c < a.calls[f].size(); ++c) printf("%s%d", c ? ", " : "", a.calls[f][c]);
+		printf("]}%s\n", f + 1 < a.functions.size() ? "," : "");
+	}
+
+	//data as ranges of one kind
+	printf("  ],\n  \"data\": [");
+	bool first = true;
+	for (int address = 0; address < 4096;)
+	{
+		const char* kind = a.map[address] & BYTE_CODE ? NULL : dataKind(a.map[address]);
+		if (!kind) { ++address; continue; }
+		int start = address;
+		while (address < 4096 && !(a.map[address] & BYTE_CODE) && dataKind(a.map[address]) == kind) ++address;
+		printf("%s\n    {\"start\": %d, \"end\": %d, \"kind\": \"%s\"}", first ? "" : ",", start, address, kind);
+		first = false;
+	}
+	printf("%s],\n", first ? "" : "\n  ");
+
+	const vector<uint16_t>* lists[4] = { &a.selfModifying, &a.indirect, &a.invalid, &a.overlapping };
+	const char* names[4] = { "selfModifying", "indirectJumps", "invalid", "overlapping" };
+	printf("  \"flags\": {");
+	for (int l = 0; l < 4; ++l)
+	{
+		printf("%s\"%s\": [", l ? ", " : "", names[l]);
+		for (size_t i = 0; i < lists[l]->size(); ++i) printf("%s%d", i ? ", " : "", (*lists[l])[i]);
+		printf("]");
+	}
+	printf("}\n}\n");
+}
+
+
+int main(int argc, char* argv[])
+{
+	bool json = false, summary = false;
+	int first = 1;
+	for (; first < argc && argv[first][0] == '-'; ++first)
+	{
+		if (!strcmp(argv[first], "--json")) json = true;
+		else if (!strcmp(argv[first], "--summary")) summary = true;
+	}
+	if (first >= argc)
+	{
+		printf("usage: analyze [--json | --summary] <rom> ...\n");
+		return 1;
+	}
+
+	if (summary) printf("%-60s %5s %6s %6s %6s %5s %4s %4s %4s\n", "rom", "size", "code", "data", "blocks", "funcs", "smc", "ind", "inv");
+	auto start = chrono::steady_clock::now();
+	int failed = 0;
+	Analysis* a = new Analysis(); //maps and ram, 8KB+
+	for (int i = first; i < argc; ++i)
+	{
+		*a = Analysis();
+		if (!analyze(argv[i], *a))
+		{
+			printf("could not open %s\n", argv[i]);
+			failed++;
+			continue;
+		}
+		if (json) printJSON(argv[i], *a);
+		else if (!summary) printListing(argv[i], *a);
+		else
+		{
+			int code = 0, data = 0;
+			for (size_t b = OFFSET_ROM; b < OFFSET_ROM + a->size; ++b)
+			{
+				code += (a->map[b] & BYTE_CODE) != 0;
+				data += !(a->map[b] & BYTE_CODE) && dataKind(a->map[b]);
+			}
+			printf("%-60.60s %5zu %5.1f%% %5.1f%% %6zu %5zu %4zu %4zu %4zu\n", argv[i], a->size,
+				a->size ? code * 100.0 / a->size : 0, a->size ? data * 100.0 / a->size : 0,
+				a->blocks.size(), a->functions.size(), a->selfModifying.size(), a->indirect.size(), a->invalid.size());
+		}
+	}
+	delete a;
+	if (summary) printf("%d roms, %.1f ms\n", argc - first, chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+	return failed ? 1 : 0;
+}
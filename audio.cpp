@@ -0,0 +1,207 @@
+#include "audio.h"
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define AUDIO_SSE2
+#endif
+
+
+/*
+* Step kernels: the band limited impulse (sinc at BLEP_CUTOFF, Blackman window) sampled at
+* BLEP_TAPS points for each sub sample position, rows sum to 1. Integrating the deltas turns each
+* impulse into a band limited step. Built once, shared by every mixer.
+*/
+typedef struct StepTables
+{
+	alignas(16) float kernel[BLEP_PHASES][BLEP_TAPS];
+	double bitRate[256];	//AUDIO_BIT_RATE of every pitch
+	uint8_t reversed[256];	//bit order of a byte reversed, pattern bytes play MSB first
+
+	StepTables()
+	{
+		for (int p = 0; p < BLEP_PHASES; ++p)
+		{
+			double sum = 0, taps[BLEP_TAPS];
+			for (int k = 0; k < BLEP_TAPS; ++k)
+			{
+				//tap k is output sample (step sample + k - (BLEP_TAPS / 2 - 1))
+				double x = k - (BLEP_TAPS / 2 - 1) - (double)p / BLEP_PHASES;
+				double sinc = x == 0 ? 2 * BLEP_CUTOFF : sin(2 * M_PI * BLEP_CUTOFF * x) / (M_PI * x);
+				double w = (x + BLEP_TAPS / 2.0) / BLEP_TAPS;	//0-1 over the kernel
+				double window = w <= 0 || w >= 1 ? 0 : 0.42 - 0.5 * cos(2 * M_PI * w) + 0.08 * cos(4 * M_PI * w);
+				taps[k] = sinc * window;
+				sum += taps[k];
+			}
+			for (int k = 0; k < BLEP_TAPS; ++k) kernel[p][k] = (float)(taps[k] / sum);
+		}
+		for (int pitch = 0; pitch < 256; ++pitch) bitRate[pitch] = AUDIO_BIT_RATE(pitch);
+		for (int byte = 0; byte < 256; ++byte)
+		{
+			reversed[byte] = 0;
+			for (int b = 0; b < 8; ++b) reversed[byte] |= ((byte >> b) & 1) << (7 - b);
+		}
+	}
+} StepTables;
+
+static const StepTables& tables()
+{
+	static const StepTables built;
+	return built;
+}
+
+
+void initMixer(AudioMixer& mixer, int rate, int channels, int format, int tickRate)
+{
+	tables();
+	mixer.rate = rate;
+	mixer.channels = channels > 0 ? channels : 1;
+	mixer.format = format;
+	mixer.tickRate = tickRate > 0 ? tickRate : 60;
+	mixer.ticks = 0;
+	mixer.samples = 0;
+	mixer.sum = 0;
+	memset(mixer.deltas, 0, sizeof(mixer.deltas));
+}
+
+
+bool requestAudio(std::atomic<uint8_t>& state, const Chip8& chip)
+{
+	uint8_t now = state.load(std::memory_order_acquire); //AUDIO_OPEN: device and mixer set before it
+	if (now == AUDIO_CLOSED && chip.timerSound) state.store(AUDIO_WANTED, std::memory_order_release);
+	return now == AUDIO_OPEN;
+}
+
+
+int sampleBytes(int format)
+{
+	switch (format)
+	{
+	case SAMPLE_U8: case SAMPLE_S8: return 1;
+	case SAMPLE_S16: return 2;
+	default: return 4;
+	}
+}
+
+
+int beginTick(AudioMixer& mixer)
+{
+	uint64_t first = mixer.ticks * mixer.rate / mixer.tickRate;
+	mixer.ticks++;
+	int samples = (int)(mixer.ticks * mixer.rate / mixer.tickRate - first);
+	mixer.samples = samples < AUDIO_MAX_TICK ? samples : AUDIO_MAX_TICK;
+	return mixer.samples;
+}
+
+
+//level change of delta at time (samples from the tick start, < samples)
+static inline void addStep(AudioMixer& mixer, double time, float delta)
+{
+	int sample = (int)time;
+	const float* kernel = tables().kernel[(int)((time - sample) * BLEP_PHASES)];
+	float* out = mixer.deltas + sample;
+#ifdef AUDIO_SSE2
+	__m128 scale = _mm_set1_ps(delta);
+	for (int k = 0; k < BLEP_TAPS; k += 4)
+		_mm_storeu_ps(out + k, _mm_add_ps(_mm_loadu_ps(out + k), _mm_mul_ps(_mm_load_ps(kernel + k), scale)));
+#else
+	for (int k = 0; k < BLEP_TAPS; ++k) out[k] += kernel[k] * delta;
+#endif
+}
+
+
+//distance (1-128) from bit to the next bit where the pattern changes, 0 if it never does
+static int nextChange(const uint64_t changes[2], int bit)
+{
+	for (int distance = 1; distance <= 128;)
+	{
+		int b = (bit + distance) & 127;
+		uint64_t word = changes[b >> 6] >> (b & 63);
+		if (word) return distance + lowestBit64(word);
+		distance += 64 - (b & 63);
+	}
+	return 0;
+}
+
+
+void mixVoice(AudioMixer& mixer, AudioVoice& voice, const Chip8& chip)
+{
+	if (!chip.timerSound)
+	{
+		if (voice.level != 0) addStep(mixer, 0, -voice.level);
+		voice.level = 0;
+		return;
+	}
+
+	//pattern as 128 bits, bit b is played b-th, and where it differs from the bit before
+	const StepTables& table = tables();
+	uint64_t bits[2] = { 0, 0 };
+	for (int i = 0; i < AUDIO_PATTERN_BYTES; ++i) bits[i >> 3] |= (uint64_t)table.reversed[chip.audioPattern[i]] << ((i & 7) * 8);
+	uint64_t changes[2] = { bits[0] ^ (bits[0] << 1 | bits[1] >> 63), bits[1] ^ (bits[1] << 1 | bits[0] >> 63) };
+
+	double perSample = table.bitRate[chip.audioPitch] / mixer.rate;
+	double start = voice.position, end = start + mixer.samples * perSample;
+	int bit = (int)start;
+	float level = (bits[(bit & 127) >> 6] >> (bit & 63)) & 1 ? AUDIO_AMPLITUDE : -AUDIO_AMPLITUDE;
+	if (level != voice.level) addStep(mixer, 0, level - voice.level);
+
+	//jump from change to change, bits equal to the one before cost nothing
+	for (int distance; (distance = nextChange(changes, bit & 127)) && bit + distance < end;)
+	{
+		bit += distance;
+		level = -level;
+		addStep(mixer, (bit - start) / perSample, 2 * level);
+	}
+	voice.level = level;
+	voice.position = fmod(end, 128);
+}
+
+
+int endTick(AudioMixer& mixer, void* out)
+{
+	int samples = mixer.samples, channels = mixer.channels;
+	float* deltas = mixer.deltas;
+
+	//integrate, leaky: steps that do not cancel exactly (float) fade instead of drifting
+	float sum = mixer.sum;
+	for (int i = 0; i < samples; ++i)
+	{
+		sum = sum * AUDIO_LEAK + deltas[i];
+		deltas[i] = sum;
+	}
+	mixer.sum = sum;
+
+	//clip, many voices can add up past full scale
+	int i = 0;
+#ifdef AUDIO_SSE2
+	__m128 low = _mm_set1_ps(-1.0f), high = _mm_set1_ps(1.0f);
+	for (; i + 4 <= samples; i += 4) _mm_storeu_ps(deltas + i, _mm_min_ps(_mm_max_ps(_mm_loadu_ps(deltas + i), low), high));
+#endif
+	for (; i < samples; ++i) deltas[i] = deltas[i] < -1.0f ? -1.0f : deltas[i] > 1.0f ? 1.0f : deltas[i];
+
+	//same sample on every channel
+	switch (mixer.format)
+	{
+	case SAMPLE_U8:
+		for (i = 0; i < samples; ++i) for (int c = 0; c < channels; ++c) ((uint8_t*)out)[i * channels + c] = (uint8_t)(128 + (int)(deltas[i] * 127));
+		break;
+	case SAMPLE_S8:
+		for (i = 0; i < samples; ++i) for (int c = 0; c < channels; ++c) ((int8_t*)out)[i * channels + c] = (int8_t)(deltas[i] * 127);
+		break;
+	case SAMPLE_S16:
+		for (i = 0; i < samples; ++i) for (int c = 0; c < channels; ++c) ((int16_t*)out)[i * channels + c] = (int16_t)(deltas[i] * 32767);
+		break;
+	case SAMPLE_S32:
+		for (i = 0; i < samples; ++i) for (int c = 0; c < channels; ++c) ((int32_t*)out)[i * channels + c] = (int32_t)(deltas[i] * 2147483520.0f);
+		break;
+	default:
+		for (i = 0; i < samples; ++i) for (int c = 0; c < channels; ++c) ((float*)out)[i * channels + c] = deltas[i];
+		break;
+	}
+
+	//the tail of the last steps starts the next tick
+	memmove(deltas, deltas + samples, BLEP_TAPS * sizeof(float));
+	memset(deltas + BLEP_TAPS, 0, samples * sizeof(float));
+	return samples * channels * sampleBytes(mixer.format);
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+* Sound synthesis, no SDL (headless tools and the library make sound without a device).
+* Each machine is a voice playing its XO-CHIP pattern (F002) at its pitch (FX3A) while timerSound runs.
+* Voices are mixed as band limited steps: every change of level adds a precomputed step kernel
+* (windowed sinc, BLEP_PHASES sub sample positions) to a delta buffer at the output rate,
+* the buffer is integrated once per tick for all voices. No aliasing at any pitch, any output rate,
+* and the cost is per level change, not per sample.
+*/
+
+#include "chip8.h"
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define AUDIO_BIT_RATE(pitch)	(4000.0 * pow(2.0, ((pitch) - 64) / 48.0))	//pattern bits per second
+
+/*band limited steps*/
+#define BLEP_PHASES		64		//sub sample positions of a step
+#define BLEP_TAPS		16		//output samples a step is spread over, multiple of 4 (SIMD), also the latency
+#define BLEP_CUTOFF		0.45	//of the output rate (Nyquist is 0.5)
+
+#define AUDIO_AMPLITUDE	0.25f	//voice level, bit 1 above zero, bit 0 below
+#define AUDIO_LEAK		0.9995f	//integrator leak per sample, removes DC (a few Hz high pass)
+#define AUDIO_MAX_TICK	4096	//samples per timer tick at most (192 kHz at 60 Hz is 3200)
+
+/*audio device of a frontend, opened on the main thread once a rom first sounds (most never do)*/
+#define AUDIO_CLOSED	0	//no sound yet, no device
+#define AUDIO_WANTED	1	//the sound timer ran, the main thread opens the device
+#define AUDIO_OPEN		2	//device open, sound is queued every tick
+#define AUDIO_FAILED	3	//could not open, not tried again
+
+/*sample formats, native byte order*/
+#define SAMPLE_U8		0
+#define SAMPLE_S8		1
+#define SAMPLE_S16		2
+#define SAMPLE_S32		3
+#define SAMPLE_F32		4
+
+/**Type Definitions********************************************************************************************************************/
+
+typedef struct AudioVoice
+{
+	double position;	//bits into the pattern, 0-128
+	float level;		//level last stepped to, 0 when silent
+} AudioVoice;
+
+typedef struct AudioMixer
+{
+	/*output, as the device negotiated it*/
+	int rate;
+	int channels;
+	int format;			//SAMPLE_*
+	int tickRate;		//timer ticks per second
+
+	uint64_t ticks;		//mixed so far, samples per tick follow rate/tickRate exactly over time
+	int samples;		//in the tick being mixed
+	float sum;			//integrator
+	alignas(16) float deltas[AUDIO_MAX_TICK + BLEP_TAPS];	//steps of this tick, the tail reaches into the next
+} AudioMixer;
+
+/*Functions***************************************************************************************************/
+
+void initMixer(AudioMixer& mixer, int rate, int channels, int format, int tickRate);	//silence, voices start anew
+int sampleBytes(int format);
+
+//one timer tick: beginTick, mixVoice per machine (after its timerTick), endTick
+int beginTick(AudioMixer& mixer);	//samples of this tick
+void mixVoice(AudioMixer& mixer, AudioVoice& voice, const Chip8& chip);	//add one machine's sound for this tick
+int endTick(AudioMixer& mixer, void* out);	//integrate, write samples * channels in the output format, returns bytes
+
+//emulation thread, every timer tick after timerTick: AUDIO_CLOSED => AUDIO_WANTED once chip's sound timer runs, true if the device is open
+bool requestAudio(std::atomic<uint8_t>& state, const Chip8& chip);
@@ -0,0 +1,130 @@
+/*
+* audiorender: sound of a rom without an audio device, headless, to a WAV file and/or timed.
+* usage: audiorender <rom> [--out file.wav] [--seconds s] [--rate hz] [--voices n] [--mode m] [--cycles c]
+*	--voices : n machines of the rom mixed into one output (CXNN drifts them apart), measures mixing cost
+* Prints the time spent in synthesis per second of sound, as a share of one core.
+*/
+
+#include "chip8.h"
+#include "audio.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+using namespace std;
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define RENDER_SECONDS		10
+#define RENDER_RATE			48000
+#define RENDER_TICK_RATE	60			//timer ticks per second
+#define RENDER_CYCLES		(700 / 60)	//FREQUENCY_CPU / FRAME_RATE defaults
+
+
+static void writeWavHeader(FILE* file, int rate, uint32_t dataBytes)
+{
+	uint32_t chunk = 36 + dataBytes, formatSize = 16, byteRate = rate * 2;
+	uint16_t pcm = 1, channels = 1, align = 2, bits = 16;
+	fwrite("RIFF", 1, 4, file); fwrite(&chunk, 4, 1, file); fwrite("WAVE", 1, 4, file);
+	fwrite("fmt ", 1, 4, file); fwrite(&formatSize, 4, 1, file); fwrite(&pcm, 2, 1, file); fwrite(&channels, 2, 1, file);
+	fwrite(&rate, 4, 1, file); fwrite(&byteRate, 4, 1, file); fwrite(&align, 2, 1, file); fwrite(&bits, 2, 1, file);
+	fwrite("data", 1, 4, file); fwrite(&dataBytes, 4, 1, file);
+}
+
+
+int main(int argc, char* argv[])
+{
+	const char* romFile = NULL;
+	const char* outFile = NULL;
+	int seconds = RENDER_SECONDS, rate = RENDER_RATE, voices = 1, mode = CHIPMODE, cycles = RENDER_CYCLES;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--out") && i + 1 < argc) outFile = argv[++i];
+		else if (!strcmp(argv[i], "--seconds") && i + 1 < argc) seconds = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--rate") && i + 1 < argc) rate = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--voices") && i + 1 < argc) voices = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--mode") && i + 1 < argc) mode = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--cycles") && i + 1 < argc) cycles = atoi(argv[++i]);
+		else romFile = argv[i];
+	}
+	if (!romFile || seconds < 1 || voices < 1 || rate < 8000 || rate / RENDER_TICK_RATE > AUDIO_MAX_TICK)
+	{
+		printf("usage: audiorender <rom> [--out file.wav] [--seconds s] [--rate hz] [--voices n] [--mode m] [--cycles c]\n");
+		return 1;
+	}
+
+	FILE* file = fopen(romFile, "rb");
+	if (!file)
+	{
+		printf("could not open %s\n", romFile);
+		return 1;
+	}
+	uint8_t rom[MAX_ROM_SIZE];
+	size_t size = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+
+	//machines share the rom's pages, each its own voice
+	Chip8 loader;
+	loader.reset(rom, size);
+	vector<Chip8*> chips(voices);
+	vector<AudioVoice> voiceStates(voices);
+	for (int v = 0; v < voices; ++v)
+	{
+		chips[v] = new Chip8();
+		chips[v]->mode = (uint8_t)mode;
+		chips[v]->reset(loader.ram);
+		chips[v]->random += (uint32_t)v * 0x9E3779B9u;
+		if (!chips[v]->random) chips[v]->random = 1;
+		voiceStates[v].position = 0;
+		voiceStates[v].level = 0;
+	}
+
+	FILE* wav = NULL;
+	if (outFile && !(wav = fopen(outFile, "wb")))
+	{
+		printf("could not write %s\n", outFile);
+		return 1;
+	}
+	if (wav) writeWavHeader(wav, rate, 0);
+
+	static AudioMixer mixer; //deltas buffer, off the stack
+	initMixer(mixer, rate, 1, SAMPLE_S16, RENDER_TICK_RATE);
+	int16_t samples[AUDIO_MAX_TICK];
+	uint32_t dataBytes = 0;
+	int sounding = 0;
+	double audioUs = 0, emulationUs = 0;
+	for (int tick = 0; tick < seconds * RENDER_TICK_RATE; ++tick)
+	{
+		auto start = chrono::steady_clock::now();
+		for (int v = 0; v < voices; ++v) chips[v]->runFrame(cycles);
+		auto emulated = chrono::steady_clock::now();
+
+		beginTick(mixer);
+		for (int v = 0; v < voices; ++v)
+		{
+			mixVoice(mixer, voiceStates[v], *chips[v]);
+			sounding += chips[v]->timerSound != 0;
+		}
+		int bytes = endTick(mixer, samples);
+		auto mixed = chrono::steady_clock::now();
+
+		emulationUs += chrono::duration<double, micro>(emulated - start).count();
+		audioUs += chrono::duration<double, micro>(mixed - emulated).count();
+		if (wav) dataBytes += (uint32_t)fwrite(samples, 1, bytes, wav);
+	}
+
+	if (wav)
+	{
+		fseek(wav, 0, SEEK_SET);
+		writeWavHeader(wav, rate, dataBytes);
+		fclose(wav);
+		printf("%s: %u samples at %d Hz\n", outFile, dataBytes / 2, rate);
+	}
+	printf("%d voices, %d s, sound on in %.1f%% of the voice ticks\n", voices, seconds, sounding * 100.0 / voices / (seconds * RENDER_TICK_RATE));
+	printf("audio %.3f ms per second of sound (%.3f%% of one core), emulation %.3f ms\n", audioUs / 1000 / seconds, audioUs / 10000 / seconds, emulationUs / 1000 / seconds);
+
+	for (int v = 0; v < voices; ++v) delete chips[v];
+	return 0;
+}
@@ -0,0 +1,92 @@
+/*
+* benchmark: cost of run ahead (see publishAhead() in main.cpp) on one rom, headless.
+* usage: benchmark <rom> [chip mode] [cycles per frame]
+* Prints the cost of copying the machine and of one emulated frame, then the cost per shown
+* frame for 1..BENCH_MAX_AHEAD frames ahead and how many fit in one 60 Hz frame.
+*/
+
+#include "chip8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+
+using namespace std;
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define BENCH_BUDGET_US		(1000000.0 / 60)	//one 60 Hz frame, 16.7 ms
+#define BENCH_WARMUP		600		//real frames before measuring (past intros and menus)
+#define BENCH_FRAMES		2000	//shown frames measured per run ahead setting
+#define BENCH_MAX_AHEAD		8		//largest run ahead in the table
+#define BENCH_CYCLES		(700 / 60)	//FREQUENCY_CPU / FRAME_RATE defaults
+
+
+double microseconds(chrono::steady_clock::time_point start)
+{
+	return chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: benchmark <rom> [chip mode] [cycles per frame]\n");
+		return 1;
+	}
+	FILE* file = fopen(argv[1], "rb");
+	if (!file)
+	{
+		printf("could not open %s\n", argv[1]);
+		return 1;
+	}
+	uint8_t rom[MAX_ROM_SIZE];
+	size_t size = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+
+	int cycles = argc > 3 ? atoi(argv[3]) : BENCH_CYCLES;
+	if (cycles < 1) cycles = 1;
+
+	//static, no 3KB machines on the stack
+	static Chip8 chip, ahead;
+	chip.mode = argc > 2 ? (uint8_t)atoi(argv[2]) : CHIPMODE;
+	chip.reset(rom, size);
+	for (int f = 0; f < BENCH_WARMUP; ++f) chip.runFrame(cycles);
+
+	//snapshot alone
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_FRAMES; ++i)
+	{
+		ahead = chip;
+		ahead.ram.write(0x0FFF, (uint8_t)i); //a written page, as a game would
+	}
+	double copy = microseconds(start) / BENCH_FRAMES;
+
+	//one frame alone
+	ahead = chip;
+	start = chrono::steady_clock::now();
+	for (int i = 0; i < BENCH_FRAMES; ++i) ahead.runFrame(cycles);
+	double frame = microseconds(start) / BENCH_FRAMES;
+
+	printf("%s, mode %d, %d cycles per frame\n", argv[1], chip.mode, cycles);
+	printf("copy machine %.3f us, emulate one frame %.3f us\n\n", copy, frame);
+	printf("%6s %14s %10s\n", "ahead", "us per frame", "of 16.7ms");
+
+	//what the emulation thread does per shown frame: one real frame, copy, n frames ahead
+	for (int n = 1; n <= BENCH_MAX_AHEAD; ++n)
+	{
+		start = chrono::steady_clock::now();
+		for (int i = 0; i < BENCH_FRAMES; ++i)
+		{
+			chip.runFrame(cycles);
+			ahead = chip;
+			for (int f = 0; f < n; ++f) ahead.runFrame(cycles);
+		}
+		double cost = microseconds(start) / BENCH_FRAMES;
+		printf("%6d %14.3f %9.3f%%\n", n, cost, cost * 100 / BENCH_BUDGET_US);
+	}
+
+	double fit = frame > 0 ? (BENCH_BUDGET_US - frame - copy) / frame : 0;
+	printf("\nabout %.0f frames ahead fit in one 60 Hz frame (emulation thread alone)\n", fit);
+	return 0;
+}
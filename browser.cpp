@@ -0,0 +1,125 @@
+#include "browser.h"
+
+
+/*picked rom, the index is closed when the browser leaves*/
+static char pickedRom[4096];
+
+
+//one page of thumbnails into the texture, frame around the selected one
+static void drawPage(SDL_Texture* page, const Library& library, int first, int selected)
+{
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(page, NULL, &pixels, &pitch)) return;
+	pitch /= 4;
+	int tileWidth = CHIP8_DISPLAY_WIDTH * BROWSER_SCALE, tileHeight = CHIP8_DISPLAY_HEIGHT * BROWSER_SCALE;
+	int height = BROWSER_GAP + BROWSER_ROWS * (tileHeight + BROWSER_GAP);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < pitch; ++x) ((uint32_t*)pixels)[y * pitch + x] = BROWSER_BACKGROUND;
+
+	for (int t = 0; t < BROWSER_COLUMNS * BROWSER_ROWS && first + t < (int)library.header->count; ++t)
+	{
+		int left = BROWSER_GAP + t % BROWSER_COLUMNS * (tileWidth + BROWSER_GAP);
+		int top = BROWSER_GAP + t / BROWSER_COLUMNS * (tileHeight + BROWSER_GAP);
+		if (first + t == selected)
+		{
+			int border = BROWSER_GAP / 2;
+			for (int y = top - border; y < top + tileHeight + border; ++y)
+				for (int x = left - border; x < left + tileWidth + border; ++x) ((uint32_t*)pixels)[y * pitch + x] = BROWSER_SELECTION;
+		}
+		rasterize(library.entries[first + t].thumbnail, (uint32_t*)pixels + top * pitch + left, pitch, BROWSER_SCALE, FILTER_NONE, PIXEL_ON, PIXEL_OFF);
+	}
+	SDL_UnlockTexture(page);
+}
+
+
+const char* browseLibrary(const char* const* dirs, int dirCount)
+{
+	if (dirCount)
+	{
+		LibraryScan scan;
+		printf("library: scanning...\n");
+		if (!scanLibrary(LIBRARY_FILE, dirs, dirCount, 0, scan)) printf("library: could not write %s\n", LIBRARY_FILE);
+		else printf("library: %d roms, %d unchanged, %d known, %d detected (%.1f ms)\n", scan.roms, scan.unchanged, scan.renamed, scan.detected, scan.ms);
+	}
+
+	Library library;
+	if (!openLibrary(library, LIBRARY_FILE) || !library.header->count)
+	{
+		printf("library: no roms in %s, scan a directory: otlchip8x --library <dir>\n", LIBRARY_FILE);
+		closeLibrary(library);
+		return NULL;
+	}
+
+	int count = (int)library.header->count, perPage = BROWSER_COLUMNS * BROWSER_ROWS;
+	int width = BROWSER_GAP + BROWSER_COLUMNS * (CHIP8_DISPLAY_WIDTH * BROWSER_SCALE + BROWSER_GAP);
+	int height = BROWSER_GAP + BROWSER_ROWS * (CHIP8_DISPLAY_HEIGHT * BROWSER_SCALE + BROWSER_GAP);
+	SDL_Texture* page = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+
+	/*
+	* keys:
+	* arrows          : select
+	* PageUp/PageDown : previous/next page
+	* Enter           : run the selected rom
+	* ESC             : quit
+	*/
+	const char* picked = NULL;
+	int selected = 0;
+	bool redraw = true, done = false;
+	SDL_Event event;
+	while (!done)
+	{
+		if (redraw)
+		{
+			const LibraryEntry& entry = library.entries[selected];
+			char title[256];
+			snprintf(title, sizeof(title), "%d/%d  %s  (mode %d)", selected + 1, count, libraryPath(library, entry), entry.mode);
+			SDL_SetWindowTitle(window, title);
+			drawPage(page, library, selected - selected % perPage, selected);
+
+			//fit window, keep the aspect of the page
+			int windowWidth, windowHeight;
+			SDL_GetRendererOutputSize(renderer, &windowWidth, &windowHeight);
+			SDL_Rect fit = { 0, 0, windowWidth, windowWidth * height / width };
+			if (fit.h > windowHeight) fit = { 0, 0, windowHeight * width / height, windowHeight };
+			fit.x = (windowWidth - fit.w) / 2;
+			fit.y = (windowHeight - fit.h) / 2;
+			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+			SDL_RenderClear(renderer);
+			SDL_RenderCopy(renderer, page, NULL, &fit);
+			SDL_RenderPresent(renderer);
+			redraw = false;
+		}
+
+		if (!SDL_WaitEventTimeout(&event, BROWSER_WAIT_MS)) continue;
+		int previous = selected;
+		if (event.type == SDL_QUIT) done = true;
+		else if (event.type == SDL_WINDOWEVENT) redraw = true;
+		else if (event.type == SDL_KEYDOWN)
+		{
+			switch (event.key.keysym.scancode)
+			{
+			case SDL_SCANCODE_LEFT: selected--; break;
+			case SDL_SCANCODE_RIGHT: selected++; break;
+			case SDL_SCANCODE_UP: selected -= BROWSER_COLUMNS; break;
+			case SDL_SCANCODE_DOWN: selected += BROWSER_COLUMNS; break;
+			case SDL_SCANCODE_PAGEUP: selected -= perPage; break;
+			case SDL_SCANCODE_PAGEDOWN: selected += perPage; break;
+			case SDL_SCANCODE_RETURN:
+				snprintf(pickedRom, sizeof(pickedRom), "%s", libraryPath(library, library.entries[selected]));
+				picked = pickedRom;
+				done = true;
+				break;
+			case SDL_SCANCODE_ESCAPE: done = true; break;
+			default: break;
+			}
+			selected = selected < 0 ? 0 : selected >= count ? count - 1 : selected;
+		}
+		if (selected != previous) redraw = true;
+	}
+
+	SDL_DestroyTexture(page);
+	closeLibrary(library);
+	SDL_SetWindowTitle(window, "Chip8");
+	return picked;
+}
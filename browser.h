@@ -0,0 +1,20 @@
+#pragma once
+
+#include "main.h"
+#include "library.h"
+
+/*MACRO definitions**************************************************************************************************************************/
+
+/*thumbnail grid*/
+#define BROWSER_COLUMNS		6
+#define BROWSER_ROWS		5
+#define BROWSER_SCALE		2			//thumbnail pixel size
+#define BROWSER_GAP			4			//texture pixels between thumbnails, selection frame is drawn in it
+#define BROWSER_BACKGROUND	0xFF202020	//ARGB8888
+#define BROWSER_SELECTION	0xFF40A0FF
+#define BROWSER_WAIT_MS		100			//event wait, nothing is drawn without an event
+
+/*Functions***************************************************************************************************/
+
+//scan dirs into LIBRARY_FILE (none: index as it is), show it in the window, path of the picked rom or NULL (ESC, closed)
+const char* browseLibrary(const char* const* dirs, int dirCount);
@@ -0,0 +1,591 @@
+/*
+* checks: self checks of the parts that need no SDL, no roms and no devices.
+* usage: checks
+* One line per check, failed conditions (with their line) above it, exit status 1 if any failed.
+*/
+
+#include "chip8.h"
+#include "trace.h"
+#include "raster.h"
+#include "analysis.h"
+#include "disasm.h"
+#include "otlchip8.h"
+#include "audio.h"
+#include "quirks.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <vector>
+
+using namespace std;
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define CHECK(condition)	check(condition, #condition, __LINE__)
+
+
+static int failed = 0;	//conditions, all checks
+
+
+static void check(bool ok, const char* condition, int line)
+{
+	if (ok) return;
+	printf("  line %d: %s\n", line, condition);
+	failed++;
+}
+
+
+//fresh machine (off the stack) running ops from OFFSET_ROM
+static Chip8* machine(const uint16_t* ops, int count, uint8_t mode = COSMACVIP)
+{
+	uint8_t rom[MAX_ROM_SIZE];
+	for (int i = 0; i < count; ++i)
+	{
+		rom[i * 2] = ops[i] >> 8;
+		rom[i * 2 + 1] = ops[i] & 0xFF;
+	}
+	Chip8* chip = new Chip8();
+	chip->mode = mode;
+	chip->reset(rom, count * 2);
+	return chip;
+}
+
+
+/*
+* Trace ring: a small ring wraps many times, the newest entries must be the last instructions
+* in order (tracedecode reads them from head - entries), fields must survive packing.
+*/
+static void checkTraceRing()
+{
+	const int entries = 8;
+	const uint16_t ops[4] = { 0x7001, 0x7101, 0x7001, 0x1200 };	//ADD V0,1  ADD V1,1  ADD V0,1  JP 0x200
+	Chip8* chip = machine(ops, 4);
+	uint64_t ring[entries];
+	chip->trace = ring;
+	chip->traceMask = entries - 1;
+
+	vector<uint16_t> pcs;
+	vector<uint8_t> vx;
+	for (int i = 0; i < 3 * entries + 3; ++i)
+	{
+		pcs.push_back(chip->PC);
+		chip->step<false>();
+		uint16_t op = ops[(pcs.back() - OFFSET_ROM) / 2];
+		vx.push_back(chip->V[(op >> 8) & 0x0F]);
+	}
+	CHECK(chip->traceHead == pcs.size());
+	for (uint64_t n = chip->traceHead - entries; n < chip->traceHead; ++n)
+	{
+		uint64_t entry = ring[n & (entries - 1)];
+		CHECK(TRACE_PC(entry) == pcs[n]);
+		CHECK(TRACE_OP(entry) == ops[(pcs[n] - OFFSET_ROM) / 2]);
+		CHECK(TRACE_VX(entry) == vx[n]);
+	}
+
+	uint64_t entry = TRACE_PACK(0x0FFF, 0xF265, 0x0ABC, 0xFE, 0x01, 0xFF);
+	CHECK(TRACE_PC(entry) == 0x0FFF && TRACE_OP(entry) == 0xF265 && TRACE_I(entry) == 0x0ABC);
+	CHECK(TRACE_VX(entry) == 0xFE && TRACE_VF(entry) == 0x01 && TRACE_SP(entry) == 0xFF);
+	delete chip;
+}
+
+
+//CXNN: every byte value comes up with NN = 0xFF, none outside NN
+static void checkRandom()
+{
+	const uint16_t ops[2] = { 0xC0FF, 0xC10F };	//RND V0, 0xFF  RND V1, 0x0F
+	Chip8* chip = machine(ops, 2);
+	bool seen[256] = { false };
+	int outside = 0;
+	for (int i = 0; i < 8192; ++i)
+	{
+		chip->PC = OFFSET_ROM;
+		chip->step<false>();
+		chip->step<false>();
+		seen[chip->V[0]] = true;
+		outside += chip->V[1] > 0x0F;
+	}
+	int values = 0;
+	for (int v = 0; v < 256; ++v) values += seen[v];
+	CHECK(values == 256);
+	CHECK(seen[0xFF]);
+	CHECK(outside == 0);
+	delete chip;
+}
+
+
+//references held on page p of ram
+static uint32_t refs(const Memory& ram, int p)
+{
+	return ram.pages[p]->refs.load();
+}
+
+
+/*
+* Copy on write ram: a copy shares every page and holds a reference on each, a write copies
+* only the page written (the other Memory keeps the old contents), references go back when
+* a copy dies, unwritten pages are one shared zero page.
+*/
+static void checkPages()
+{
+	Memory blank;
+	CHECK(blank.pages[0] == blank.pages[PAGE_COUNT - 1]);
+	CHECK(blank.read(0x0ABC) == 0);
+
+	Memory* original = new Memory();
+	original->write(0x0200, 0x12);
+	original->write(0x0300, 0x34);
+	CHECK(original->pages[2] != blank.pages[2] && refs(*original, 2) == 1);
+	CHECK(original->pages[4] == blank.pages[4]);
+
+	Memory* copy = new Memory(*original);
+	int shared = 0;
+	for (int p = 0; p < PAGE_COUNT; ++p) shared += copy->pages[p] == original->pages[p];
+	CHECK(shared == PAGE_COUNT);
+	CHECK(refs(*original, 2) == 2 && refs(*original, 3) == 2);
+
+	copy->write(0x0201, 0x56);
+	CHECK(copy->pages[2] != original->pages[2]);
+	CHECK(refs(*original, 2) == 1 && refs(*copy, 2) == 1);
+	CHECK(copy->pages[3] == original->pages[3] && refs(*original, 3) == 2);
+	CHECK(copy->read(0x0200) == 0x12 && copy->read(0x0201) == 0x56);
+	CHECK(original->read(0x0201) == 0);
+
+	//assigning back shares the copy's pages again
+	*original = *copy;
+	CHECK(original->pages[2] == copy->pages[2] && refs(*copy, 2) == 2);
+	CHECK(original->read(0x0201) == 0x56);
+
+	delete copy;
+	CHECK(refs(*original, 2) == 1 && refs(*original, 3) == 1);
+
+	uint32_t zeroRefs = refs(blank, 0);	//14 of them original's
+	original->clear();
+	CHECK(original->pages[2] == blank.pages[2] && original->read(0x0200) == 0);
+	CHECK(refs(blank, 0) == zeroRefs + 2);
+	delete original;
+	CHECK(refs(blank, 0) == zeroRefs - (PAGE_COUNT - 2));	//all 16 it held after clear()
+}
+
+
+//FAULT_PC: counted once per jump, call or return leaving the program area, never for plain instructions
+static void checkPcFaults()
+{
+	const uint16_t ops[3] = { 0x6004, 0x7001, 0x1202 };	//LD V0,4  ADD V0,1  JP 0x202
+	Chip8* chip = machine(ops, 3);
+	for (int i = 0; i < 100; ++i) chip->step<false>();
+	CHECK(chip->faults[FAULT_PC] == 0);
+
+	const uint16_t out[2] = { 0xBFFF, 0x1100 };	//JP V0, 0xFFF (V0 = 0)  JP 0x100
+	delete chip;
+	chip = machine(out, 2);
+	chip->step<false>();
+	CHECK(chip->PC == 0x0FFF && chip->faults[FAULT_PC] == 1);
+	chip->PC = OFFSET_ROM + 2;
+	chip->step<false>();
+	CHECK(chip->PC == 0x0100 && chip->faults[FAULT_PC] == 2);
+	chip->step<false>();	//0000: call 0x000, pushes and leaves again
+	CHECK(chip->faults[FAULT_PC] == 3);
+	delete chip;
+}
+
+
+/*
+* Opcode classes: opcodeClass() says OP_INVALID exactly for the opcodes the interpreter counts
+* as FAULT_OPCODE, and the disassembler writes DW for exactly those (all 65536 opcodes).
+*/
+static void checkOpcodeClasses()
+{
+	const uint16_t nop[1] = { 0x0000 };
+	Chip8* chip = machine(nop, 1);
+	int disagree = 0, disasmDisagree = 0;
+	for (uint32_t op = 0; op <= 0xFFFF; ++op)
+	{
+		uint8_t code[2] = { (uint8_t)(op >> 8), (uint8_t)op };
+		chip->ram.load(OFFSET_ROM, code, 2);
+		chip->PC = OFFSET_ROM;
+		chip->stackPointer = 0;
+		chip->faults[FAULT_OPCODE] = 0;
+		chip->step<false>();
+		bool invalid = opcodeClass((uint16_t)op) == OP_INVALID;
+		disagree += invalid != (chip->faults[FAULT_OPCODE] != 0);
+
+		char text[32];
+		disassemble((uint16_t)op, text, sizeof(text));
+		disasmDisagree += invalid != !strncmp(text, "DW", 2);
+	}
+	CHECK(disagree == 0);
+	CHECK(disasmDisagree == 0);
+	CHECK(opcodeClass(0x5121) == OP_SKIP && opcodeClass(0x9ABF) == OP_SKIP);
+	CHECK(opcodeClass(0x0123) == OP_CALL && opcodeClass(0x00EE) == OP_RETURN && opcodeClass(0xB200) == OP_INDIRECT);
+	delete chip;
+}
+
+
+/*
+* Analyzer: blocks, successors, functions and calls of a small rom, sprite bytes as many as
+* DXYN draws (none for DXY0), 5XYN with N != 0 followed as a skip.
+*/
+static void checkAnalyzer()
+{
+	const uint8_t rom[] = {
+		0xA2, 0x16,		//200  LD I, 0x216
+		0xD0, 0x13,		//202  DRW V0, V1, 3
+		0xA2, 0x19,		//204  LD I, 0x219
+		0xD0, 0x10,		//206  DRW V0, V1, 0
+		0x22, 0x12,		//208  CALL 0x212
+		0x51, 0x21,		//20A  SE V1, V2 (N = 1)
+		0x12, 0x0E,		//20C  JP 0x20E
+		0x12, 0x0E,		//20E  JP 0x20E
+		0xFF, 0xFF,		//210  unreached
+		0x00, 0xEE,		//212  RET
+		0xFF, 0xFF,		//214  unreached
+		0xF0, 0x90, 0xF0,	//216  sprite
+		0xAA,			//219  after I of DXY0
+	};
+	Analysis* a = new Analysis();
+	CHECK(analyzeRom(rom, sizeof(rom), *a));
+
+	CHECK(a->blocks.size() == 5);
+	int entry = blockAt(*a, 0x200), skip = blockAt(*a, 0x20A), jump = blockAt(*a, 0x20C), halt = blockAt(*a, 0x20E), callee = blockAt(*a, 0x212);
+	CHECK(entry >= 0 && skip >= 0 && jump >= 0 && halt >= 0 && callee >= 0);
+	if (entry >= 0 && skip >= 0 && jump >= 0 && halt >= 0 && callee >= 0)
+	{
+		const Block& b = a->blocks[entry];
+		CHECK(b.kind == END_CALL && b.end == 0x20A && b.call == 0x212 && b.successors == vector<uint16_t>(1, 0x20A));
+		CHECK(a->blocks[skip].kind == END_SKIP && a->blocks[skip].successors.size() == 2);
+		CHECK(a->blocks[skip].successors[0] == 0x20C && a->blocks[skip].successors[1] == 0x20E);
+		CHECK(a->blocks[jump].kind == END_JUMP && a->blocks[jump].successors == vector<uint16_t>(1, 0x20E));
+		CHECK(a->blocks[halt].kind == END_HALT && a->blocks[halt].successors.empty());
+		CHECK(a->blocks[callee].kind == END_RETURN);
+		CHECK(b.function == 0 && a->blocks[halt].function == 0 && a->blocks[callee].function == 1);
+	}
+	CHECK(a->functions.size() == 2 && a->functions[0] == 0x200 && a->functions[1] == 0x212);
+	CHECK(a->calls.size() == 2 && a->calls[0] == vector<uint16_t>(1, 0x212) && a->calls[1].empty());
+
+	int sprite = 0;
+	for (int address = 0; address < 4096; ++address) sprite += (a->map[address] & BYTE_SPRITE) != 0;
+	CHECK(sprite == 3 && (a->map[0x216] & a->map[0x218] & BYTE_SPRITE));
+	CHECK(!(a->map[0x210] & BYTE_CODE) && !(a->map[0x214] & BYTE_CODE));
+	CHECK(a->invalid.empty() && a->indirect.empty() && a->overlapping.empty());
+	delete a;
+}
+
+
+//C API: otl_chip8_create() takes the OTL_MODE_* values only
+static void checkApiModes()
+{
+	const int modes[4] = { OTL_MODE_AUTO, OTL_MODE_COSMACVIP, OTL_MODE_CHIP48, OTL_MODE_SUPERCHIP };
+	for (int m = 0; m < 4; ++m)
+	{
+		otl_chip8* chip = otl_chip8_create(modes[m]);
+		CHECK(chip != NULL);
+		otl_chip8_destroy(chip);
+	}
+	const int bad[5] = { -1, 3, 5, 7, 256 + OTL_MODE_COSMACVIP };
+	for (int m = 0; m < 5; ++m) CHECK(otl_chip8_create(bad[m]) == NULL);
+}
+
+
+/*
+* quirks.db lines with a mode other than COSMACVIP, CHIP48, SUPERCHIP are not trusted:
+* the rom is detected again and the new line is used from then on.
+* The working directory's quirks.db is put back afterwards.
+*/
+static void checkCachedModes()
+{
+	vector<char> saved;
+	FILE* file = fopen(QUIRKS_FILE, "rb");
+	bool existed = file != NULL;
+	if (file)
+	{
+		char buffer[4096];
+		size_t n;
+		while ((n = fread(buffer, 1, sizeof(buffer), file)) > 0) saved.insert(saved.end(), buffer, buffer + n);
+		fclose(file);
+	}
+
+	const uint8_t rom[4] = { 0x60, 0x05, 0x12, 0x02 };	//V0 = 5, loop
+	unsigned long long hash = hashBytes(rom, sizeof(rom));
+	const int modes[6] = { 0, 3, 8, 255, -1, SUPERCHIP };
+	for (int m = 0; m < 6; ++m)
+	{
+		file = fopen(QUIRKS_FILE, "w");
+		CHECK(file != NULL);
+		if (!file) break;
+		fprintf(file, "%016llx %d\n", hash, modes[m]);
+		fclose(file);
+
+		bool cached;
+		uint8_t mode = autoMode(rom, sizeof(rom), &cached);
+		CHECK(mode == COSMACVIP || mode == CHIP48 || mode == SUPERCHIP);
+		CHECK(cached == (modes[m] == SUPERCHIP));
+		if (modes[m] == SUPERCHIP) CHECK(mode == SUPERCHIP);
+
+		uint8_t again = autoMode(rom, sizeof(rom), &cached);
+		CHECK(cached && again == mode);
+	}
+
+	if (existed)
+	{
+		file = fopen(QUIRKS_FILE, "wb");
+		if (file)
+		{
+			fwrite(saved.data(), 1, saved.size(), file);
+			fclose(file);
+		}
+	}
+	else remove(QUIRKS_FILE);
+}
+
+
+//C API sound: a mixer per machine from its first otl_chip8_audio() on, clones start their own
+static void checkApiAudio()
+{
+	const uint8_t rom[6] = { 0x60, 0x40, 0xF0, 0x18, 0x12, 0x04 };	//sound timer 0x40, halt
+	otl_chip8* chip = otl_chip8_create(OTL_MODE_COSMACVIP);
+	CHECK(otl_chip8_load_rom(chip, rom, sizeof(rom)) == OTL_CHIP8_OK);
+	otl_chip8* silent = otl_chip8_clone(chip);	//before any sound
+	float samples[800];
+	int loud = 0;
+	for (int f = 0; f < 10; ++f)
+	{
+		otl_chip8_run_frame(chip, 12);
+		otl_chip8_run_frame(silent, 12);
+		CHECK(otl_chip8_audio(chip, 48000, samples, 800) == 800);
+		for (int i = 0; i < 800; ++i) loud += samples[i] != 0;
+	}
+	CHECK(loud > 0);
+
+	otl_chip8* copy = otl_chip8_clone(chip);
+	CHECK(otl_chip8_audio(copy, 44100, samples, 800) == 735);
+	CHECK(otl_chip8_audio(chip, 48000, samples, 100) == 0);	//too small, nothing written
+	CHECK(otl_chip8_audio(chip, 48000, samples, 800) == 800);
+	otl_chip8_destroy(copy);
+	otl_chip8_destroy(silent);	//never had a mixer
+	otl_chip8_destroy(chip);
+}
+
+
+//seconds of one machine's sound, mono float at rate, timerSound kept running if sounding
+static vector<float> render(Chip8& chip, int rate, int seconds, bool sounding)
+{
+	AudioMixer* mixer = new AudioMixer();	//delta buffer, 16KB+
+	AudioVoice voice = { 0, 0 };
+	initMixer(*mixer, rate, 1, SAMPLE_F32, 60);
+	vector<float> out;
+	float tick[AUDIO_MAX_TICK];
+	for (int t = 0; t < 60 * seconds; ++t)
+	{
+		chip.timerSound = sounding ? 255 : 0;
+		beginTick(*mixer);
+		mixVoice(*mixer, voice, chip);
+		int samples = endTick(*mixer, tick) / sampleBytes(SAMPLE_F32);
+		out.insert(out.end(), tick, tick + samples);
+	}
+	delete mixer;
+	return out;
+}
+
+
+/*
+* Sound: silence is zeros, ticks add up to the rate exactly, the default pattern at pitch 64
+* is a 500 Hz square of AUDIO_AMPLITUDE (ringing of the steps aside), a square above Nyquist
+* comes out (almost) silent instead of aliased down.
+*/
+static void checkMixer()
+{
+	const uint16_t nop[1] = { 0x1200 };
+	Chip8* chip = machine(nop, 1);
+
+	vector<float> silence = render(*chip, 48000, 1, false);
+	int loud = 0;
+	for (size_t i = 0; i < silence.size(); ++i) loud += silence[i] != 0;
+	CHECK(silence.size() == 48000 && loud == 0);
+
+	const int rates[4] = { 8000, 11025, 44100, 48000 };	//11025 / 60 is not whole
+	for (int r = 0; r < 4; ++r) CHECK(render(*chip, rates[r], 2, true).size() == (size_t)rates[r] * 2);
+
+	//skip the first tick, the first step rings in
+	vector<float> beep = render(*chip, 48000, 2, true);
+	int crossings = 0, first = -1, last = -1;
+	float peak = 0;
+	for (size_t i = 800; i < beep.size(); ++i)
+	{
+		peak = fmaxf(peak, fabsf(beep[i]));
+		if ((beep[i] >= 0) == (beep[i - 1] >= 0)) continue;
+		crossings++;
+		if (first < 0) first = (int)i;
+		last = (int)i;
+	}
+	double period = 2.0 * (last - first) / (crossings - 1);	//samples, two crossings per period
+	CHECK(fabs(period - 96.0) < 0.1);
+	CHECK(abs(crossings - 2 * 500 * (int)(beep.size() - 800) / 48000) <= 2);
+	CHECK(peak > AUDIO_AMPLITUDE * 0.9f && peak < AUDIO_AMPLITUDE * 1.2f);
+
+	//alternating bits at the top pitch: a 31.5 kHz square, every harmonic above 24 kHz
+	memset(chip->audioPattern, 0xAA, sizeof(chip->audioPattern));
+	chip->audioPitch = 255;
+	vector<float> high = render(*chip, 48000, 1, true);
+	double energy = 0;
+	for (size_t i = 800; i < high.size(); ++i) energy += high[i] * high[i];
+	double rms = sqrt(energy / (high.size() - 800));
+	CHECK(rms < AUDIO_AMPLITUDE * 0.05);
+	delete chip;
+}
+
+
+//frame by frame as a frontend runs it, audio state as the emulation thread sees it
+static uint8_t audioAfter(const uint16_t* ops, int count, int frames)
+{
+	Chip8* chip = machine(ops, count);
+	std::atomic<uint8_t> state(AUDIO_CLOSED);
+	for (int f = 0; f < frames; ++f)
+	{
+		chip->runFrame(12);
+		requestAudio(state, *chip);
+	}
+	delete chip;
+	return state;
+}
+
+
+/*
+* Audio device only for roms that sound: no FX18 (or FX18 with 1, it ends at the tick) never asks
+* for one, the first FX18 does, only an open device gets sound queued.
+*/
+static void checkAudioRequest()
+{
+	const uint16_t quiet[6] = { 0x6005, 0xF015, 0xF007, 0x3000, 0x1204, 0x1200 };	//delay timer loop, no FX18
+	CHECK(audioAfter(quiet, 6, 600) == AUDIO_CLOSED);
+	const uint16_t tick[3] = { 0x6001, 0xF018, 0x1204 };	//sound timer 1
+	CHECK(audioAfter(tick, 3, 600) == AUDIO_CLOSED);
+	const uint16_t beep[7] = { 0x6101, 0x7101, 0x3140, 0x1202, 0x6105, 0xF118, 0x120C };	//count to 0x40 (~16 frames), then sound timer 5
+	CHECK(audioAfter(beep, 7, 1) == AUDIO_CLOSED);
+	CHECK(audioAfter(beep, 7, 60) == AUDIO_WANTED);
+
+	const uint16_t nop[1] = { 0x1200 };
+	Chip8* chip = machine(nop, 1);
+	chip->timerSound = 10;
+	std::atomic<uint8_t> state(AUDIO_WANTED);
+	CHECK(!requestAudio(state, *chip) && state == AUDIO_WANTED);
+	state = AUDIO_FAILED;
+	CHECK(!requestAudio(state, *chip) && state == AUDIO_FAILED);
+	state = AUDIO_OPEN;
+	chip->timerSound = 0;
+	CHECK(requestAudio(state, *chip));
+	delete chip;
+}
+
+
+//Scale2x the plain way, one pixel at a time, edges repeated
+static vector<bool> referenceScale2x(const vector<bool>& in, int width, int height)
+{
+	vector<bool> out(4 * width * height);
+	for (int y = 0; y < height; ++y)
+		for (int x = 0; x < width; ++x)
+		{
+			bool E = in[y * width + x];
+			bool B = in[(y ? y - 1 : y) * width + x], H = in[(y < height - 1 ? y + 1 : y) * width + x];
+			bool D = in[y * width + (x ? x - 1 : x)], F = in[y * width + (x < width - 1 ? x + 1 : x)];
+			bool E0 = E, E1 = E, E2 = E, E3 = E;
+			if (B != H && D != F)
+			{
+				E0 = D == B ? D : E;
+				E1 = B == F ? F : E;
+				E2 = D == H ? D : E;
+				E3 = H == F ? F : E;
+			}
+			out[2 * y * 2 * width + 2 * x] = E0;
+			out[2 * y * 2 * width + 2 * x + 1] = E1;
+			out[(2 * y + 1) * 2 * width + 2 * x] = E2;
+			out[(2 * y + 1) * 2 * width + 2 * x + 1] = E3;
+		}
+	return out;
+}
+
+
+/*
+* Rasterizer: every scale 1-8 with every filter against the plain version (filters the scale
+* does not allow fall back), random and edge heavy images, nothing written past the width.
+*/
+static void checkRasterizer()
+{
+	const uint32_t on = 0xFF12AB34, off = 0xFF000001, guard = 0xDEADBEEF;
+	uint64_t images[3][32];
+	uint32_t random = 0x2545F491;
+	for (int y = 0; y < 32; ++y)
+	{
+		uint64_t row = 0;
+		for (int i = 0; i < 2; ++i)
+		{
+			random ^= random << 13; random ^= random >> 17; random ^= random << 5;
+			row = row << 32 | random;
+		}
+		images[0][y] = row;
+		images[1][y] = y & 1 ? 0xAAAAAAAAAAAAAAAAull : 0x5555555555555555ull;	//checkerboard, edges everywhere
+		images[2][y] = y < 16 ? 0x8000000000000001ull << (y & 7) : ~0ull >> y;	//lit borders and diagonals
+	}
+
+	for (int i = 0; i < 3; ++i)
+	{
+		vector<bool> plain(64 * 32);
+		for (int y = 0; y < 32; ++y)
+			for (int x = 0; x < 64; ++x) plain[y * 64 + x] = (images[i][y] >> (63 - x)) & 1;
+		vector<bool> smooth2 = referenceScale2x(plain, 64, 32), smooth4 = referenceScale2x(smooth2, 128, 64);
+
+		for (int scale = 1; scale <= 8; ++scale)
+			for (int filter = FILTER_NONE; filter <= FILTER_SCALE4X; ++filter)
+			{
+				int used = filter == FILTER_SCALE4X && scale % 4 ? FILTER_SCALE2X : filter;
+				if (used == FILTER_SCALE2X && scale % 2) used = FILTER_NONE;
+				const vector<bool>& expected = used == FILTER_SCALE4X ? smooth4 : used == FILTER_SCALE2X ? smooth2 : plain;
+				int factor = used == FILTER_SCALE4X ? 4 : used == FILTER_SCALE2X ? 2 : 1, imageWidth = 64 * factor;
+
+				int width = 64 * scale, height = 32 * scale, pitch = width + 5;
+				vector<uint32_t> pixels((size_t)pitch * height, guard);
+				rasterize(images[i], pixels.data(), pitch, scale, filter, on, off);
+				int wrong = 0, overrun = 0;
+				for (int y = 0; y < height; ++y)
+				{
+					for (int x = 0; x < width; ++x)
+					{
+						bool lit = expected[(y * factor / scale) * imageWidth + x * factor / scale];
+						wrong += pixels[(size_t)y * pitch + x] != (lit ? on : off);
+					}
+					for (int x = width; x < pitch; ++x) overrun += pixels[(size_t)y * pitch + x] != guard;
+				}
+				CHECK(wrong == 0);
+				CHECK(overrun == 0);
+			}
+	}
+}
+
+
+int main()
+{
+	struct { const char* name; void (*run)(); } checks[] = {
+		{ "trace ring", checkTraceRing },
+		{ "rasterizer", checkRasterizer },
+		{ "CXNN random", checkRandom },
+		{ "copy on write pages", checkPages },
+		{ "PC faults", checkPcFaults },
+		{ "opcode classes", checkOpcodeClasses },
+		{ "analyzer", checkAnalyzer },
+		{ "C API modes", checkApiModes },
+		{ "cached modes", checkCachedModes },
+		{ "C API audio", checkApiAudio },
+		{ "band limited mixer", checkMixer },
+		{ "audio only when sounding", checkAudioRequest },
+	};
+
+	int failedChecks = 0, count = (int)(sizeof(checks) / sizeof(checks[0]));
+	for (int c = 0; c < count; ++c)
+	{
+		int before = failed;
+		checks[c].run();
+		if (failed != before) failedChecks++;
+		printf("%-28s %s\n", checks[c].name, failed == before ? "ok" : "FAIL");
+	}
+	printf("%d checks, %d failed\n", count, failedChecks);
+	return failedChecks ? 1 : 0;
+}
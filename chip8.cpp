@@ -0,0 +1,723 @@
+#include "chip8.h"
+#include "trace.h"
+#include <string.h>
+
+
+/*MACRO definitions**************************************************************************************************************************/
+
+/*Registers*/
+#define V0		V[0x0]
+#define V1 		V[0x1]
+#define V2 		V[0x2]
+#define V3 		V[0x3]
+#define V4 		V[0x4]
+#define V5 		V[0x5]
+#define V6 		V[0x6]
+#define V7 		V[0x7]
+#define V8 		V[0x8]
+#define V9 		V[0x9]
+#define VA		V[0xA]
+#define VB		V[0xB]
+#define VC		V[0xC]
+#define VD		V[0xD]
+#define VE		V[0xE]
+#define VF		V[0xF]
+
+/*instruction extractions (here, not in chip8.h, X and N would leak into every includer)*/
+#define ITYPE	(instruction>>12)				//instruction type(Most significant Byte)
+#define X		((instruction & 0x0F00) >> 8)	//X Register name
+#define VX		V[X]							//X Register
+#define VY		V[(instruction & 0x00F0) >> 4]	//Y Register
+#define N		(instruction & 0x000F)			//Immediate
+#define NN		(instruction & 0x00FF)			//Immediate
+#define NNN		(instruction & 0x0FFF)			//Address
+
+#define RANDOM_SEED		0x2545F491	//CXNN generator start, any non zero value
+
+
+/*ram pages*/
+static Page zeroPage = { { 1 }, { 0 } };	//shared by every unwritten page, its own reference keeps it alive
+
+
+static Page* retain(Page* page)
+{
+	page->refs.fetch_add(1, std::memory_order_relaxed);
+	return page;
+}
+
+
+static void release(Page* page)
+{
+	if (page->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) delete page;
+}
+
+
+Memory::Memory()
+{
+	for (int p = 0; p < PAGE_COUNT; ++p) pages[p] = retain(&zeroPage);
+}
+
+
+Memory::Memory(const Memory& other)
+{
+	for (int p = 0; p < PAGE_COUNT; ++p) pages[p] = retain(other.pages[p]);
+}
+
+
+Memory& Memory::operator=(const Memory& other)
+{
+	for (int p = 0; p < PAGE_COUNT; ++p)
+	{
+		if (pages[p] == other.pages[p]) continue;
+		Page* old = pages[p];
+		pages[p] = retain(other.pages[p]);
+		release(old);
+	}
+	return *this;
+}
+
+
+Memory::~Memory()
+{
+	for (int p = 0; p < PAGE_COUNT; ++p) release(pages[p]);
+}
+
+
+void Memory::ownPage(int page)
+{
+	//other owners keep the old page, this one gets a private copy
+	Page* copy = new Page;
+	copy->refs.store(1, std::memory_order_relaxed);
+	memcpy(copy->data, pages[page]->data, PAGE_SIZE);
+	release(pages[page]);
+	pages[page] = copy;
+}
+
+
+void Memory::load(uint16_t address, const uint8_t* data, size_t size)
+{
+	while (size)
+	{
+		address &= 0x0FFF;
+		size_t offset = address & (PAGE_SIZE - 1);
+		size_t length = PAGE_SIZE - offset < size ? PAGE_SIZE - offset : size;
+		memcpy(writablePage(address >> PAGE_SHIFT) + offset, data, length);
+		address += (uint16_t)length;
+		data += length;
+		size -= length;
+	}
+}
+
+
+void Memory::copyTo(uint8_t out[4096]) const
+{
+	for (int p = 0; p < PAGE_COUNT; ++p) memcpy(out + p * PAGE_SIZE, pages[p]->data, PAGE_SIZE);
+}
+
+
+void Memory::clear()
+{
+	for (int p = 0; p < PAGE_COUNT; ++p)
+	{
+		if (pages[p] == &zeroPage) continue;
+		release(pages[p]);
+		pages[p] = retain(&zeroPage);
+	}
+}
+
+
+Chip8::Chip8()
+{
+	mode = CHIPMODE;
+	onKeyRead = NULL;
+	trace = NULL;
+	traceMask = 0;
+	traceHead = 0;
+	watchRead = watchWrite = NULL;
+	watchHit = false;
+	watchAddress = 0;
+	watchKind = 0;
+	vramVersion = 0;
+	clear();
+}
+
+
+void Chip8::clear()
+{
+	//set all to 0 (mode, trace, hooks kept)
+	ram.clear();
+
+	for (int i = 0; i < 64; ++i)
+		for (int j = 0; j < 32; ++j)
+			vram[i][j] = 0;
+	vramVersion++;
+
+	stackPointer = 0;
+
+	for (int i = 0; i < 256; ++i)
+		stack[i] = 0;
+
+	PC = 0;
+
+	I = 0;
+
+	for (int i = 0; i < 16; ++i)
+		V[i] = 0;
+
+	timerDelay = 0;
+
+	timerSound = 0;
+	memset(audioPattern, AUDIO_PATTERN_DEFAULT, sizeof(audioPattern));
+	audioPitch = AUDIO_PITCH_DEFAULT;
+
+	memset(faults, 0, sizeof(faults));
+
+	keys = 0;
+	waitedKey = 0;
+	waitingKeyPress = true;
+	random = RANDOM_SEED;
+}
+
+void Chip8::loadFont()
+{
+	uint8_t  font[] = {
+		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+		0x20, 0x60, 0x20, 0x20, 0x70, // 1
+		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+	};
+	ram.load(OFFSET_FONT, font, sizeof(font));
+}
+
+
+size_t Chip8::loadProgram(const uint8_t* rom, size_t size)
+{
+	if (size > MAX_ROM_SIZE) size = MAX_ROM_SIZE;
+	ram.load(OFFSET_ROM, rom, size);
+	PC = OFFSET_ROM;
+	return size;
+}
+
+
+void Chip8::reset(const uint8_t* rom, size_t size)
+{
+	clear();
+	loadFont();
+	loadProgram(rom, size);
+}
+
+
+void Chip8::reset(const Memory& image)
+{
+	clear();
+	ram = image;
+	PC = OFFSET_ROM;
+}
+
+
+uint16_t Chip8::fetch()
+{
+	//get instruction
+	uint16_t instruction = ram.read(PC) << 8 | ram.read(PC + 1); //join MSB8 and LSB8 to get instruction16, PC incremented by 2
+	PC += 2;
+	//printf("fetched: %04x at %02x\n", instruction, PC - 2);
+	return instruction;
+}
+
+/*
+* ram data access of the two engines:
+* DEBUG false : plain array access, the same code as without a debugger
+* DEBUG true  : also checks watchpoints
+* The engine is picked by the caller per run of instructions, never per instruction.
+* Addresses wrap at 4KB.
+*/
+template <bool DEBUG>
+uint8_t Chip8::readRam(uint16_t address)
+{
+	if (DEBUG && bitmapTest(watchRead, address))
+	{
+		watchHit = true;
+		watchAddress = address & 0x0FFF;
+		watchKind = WATCH_READ;
+	}
+	return ram.read(address);
+}
+
+
+template <bool DEBUG>
+void Chip8::writeRam(uint16_t address, uint8_t value)
+{
+	if (DEBUG && bitmapTest(watchWrite, address))
+	{
+		watchHit = true;
+		watchAddress = address & 0x0FFF;
+		watchKind = WATCH_WRITE;
+	}
+	ram.write(address, value);
+}
+
+
+//keep in step with decodeandexecute(): OP_INVALID exactly where it counts FAULT_OPCODE
+uint8_t opcodeClass(uint16_t instruction)
+{
+	switch (ITYPE)
+	{
+	case 0x0:
+		if (instruction == 0x00E0) return OP_PLAIN;
+		return instruction == 0x00EE ? OP_RETURN : OP_CALL;
+	case 0x1: return OP_JUMP;
+	case 0x2: return OP_CALL;
+	case 0x3: case 0x4: case 0x5: case 0x9: return OP_SKIP;	//5XYN/9XYN: N is not decoded
+	case 0x8: return (instruction & 0x000F) <= 0x7 || (instruction & 0x000F) == 0xE ? OP_PLAIN : OP_INVALID;
+	case 0xB: return OP_INDIRECT;
+	case 0xE: return (instruction & 0x00FF) == 0x9E || (instruction & 0x00FF) == 0xA1 ? OP_SKIP : OP_INVALID;
+	case 0xF:
+		switch (instruction & 0x00FF)
+		{
+		case 0x02: return X ? OP_INVALID : OP_PLAIN;
+		case 0x07: case 0x0A: case 0x15: case 0x18: case 0x3A: case 0x1E: case 0x29: case 0x33: case 0x55: case 0x65: return OP_PLAIN;
+		default: return OP_INVALID;
+		}
+	default: return OP_PLAIN;	//6 7 A C D
+	}
+}
+
+
+template <bool DEBUG>
+void Chip8::decodeandexecute(uint16_t instruction)
+{
+	//printf("VX:%2x, VY:%2x , VF:%2x\n", VX, VY, VF);
+
+	switch (ITYPE)
+	{
+	case 0x0:
+		switch (instruction)
+		{
+		case 0x00E0:
+			//printf("00E0 display clear");
+			clearDisplay();
+			break;
+		case 0x00EE:
+			//printf("00EE return from subroutine");
+			jump(pop());
+			break;
+		default:
+			//printf("0NNN call");
+			push(PC);
+			jump(NNN);
+			break;
+		}
+		break;
+	case 0x1:
+		//printf("1NNN goto NNN");
+		jump(NNN);
+		break;
+	case 0x2:
+		//printf("2NNN call subrouting at NNN");
+		push(PC);
+		jump(NNN);
+		break;
+	case 0x3:
+		//printf("3XNN if VX==NN skip next instruction");
+		if (VX == (NN)) PC += 2;
+		break;
+	case 0x4:
+		//printf("4XNN if VX!=NN skip next instruction");
+		if (VX != (NN)) PC += 2;
+		break;
+	case 0x5:
+		//printf("5XY0 if VX==VY skip next instruction");
+		if (VX == VY) PC += 2;
+		break;
+	case 0x6:
+		//printf("6XNN set VX=NN");
+		VX = NN;
+		break;
+	case 0x7:
+		//printf("7XNN set VX=VX+NN, VF not changed");
+		VX += NN;
+		break;
+	case 0x8:
+		switch (instruction & 0x000F)
+		{
+		case 0x0:
+			//printf("8XY0 VX = VY");
+			VX = VY;
+			break;
+		case 0x1:
+			//printf("8XY1 VX = VY | VY (or)");
+			VX |= VY;
+			if (mode & COSMACVIP) VF = 0;
+			break;
+		case 0x2:
+			//printf("8XY2 VX = VY & VY (and)");
+			VX &= VY;
+			if (mode & COSMACVIP) VF = 0;
+			break;
+		case 0x3:
+			//printf("8XY3 VX ^= VY (xor)");
+			VX ^= VY;
+			if (mode & COSMACVIP) VF = 0;
+			break;
+		case 0x4:
+		{
+			//printf("8XY4 VX = VX + VY (add), VF carry flag");
+			uint16_t carrysum = (uint16_t)VX + (uint16_t)VY;
+			VX = carrysum & 0x00FF;
+			VF = uint8_t(carrysum >> 8) & 0x01;
+			break;
+		}
+		case 0x5:
+		{
+			//printf("8XY5 VX = VX - VY (sub), VF burrow flag, 0 when burrow");
+			int borrowdiff = ((uint16_t)VX | 0x0100) - (uint16_t)VY;
+			VX = borrowdiff & 0x00FF;
+			VF = (borrowdiff >> 8) & 0x01;
+			break;
+		}
+		case 0x6:
+			//printf("start %02x %02x %02x should be %02x %02x %02x\n", VX, VY, VF, VX >> 1, VY >> 1, VF >> 1);
+			if (mode & COSMACVIP) //use VY
+			{
+				//printf("8XY6 VX = VY >> 1 (shiftr1), shift out to VF");
+				uint8_t tmp = VY;
+				VX = tmp >> 1;
+				VF = tmp & 0x01;
+			}
+			if (mode & (CHIP48 | SUPERCHIP))
+			{
+				//ignore VY
+				uint8_t tmp = VX;
+				VX = tmp >> 1;
+				VF = tmp & 0x01;
+			}
+			//printf("end %02x %02x %02x\n", VX, VY, VF); //std::cin.get();
+			break;
+		case 0x7:
+		{
+			//printf("8XY7 VX = VY - VX (sub reverse), VF burrow flag, 0 when burrow");
+			uint16_t borrowdiff = ((uint16_t)VY | 0x0100) - (uint16_t)VX;
+			VX = borrowdiff & 0x00FF;
+			VF = (borrowdiff >> 8) & 0x01;
+			break;
+		}
+		case 0xE:
+			if (mode & COSMACVIP) //use VY
+			{
+				//printf("8XYE VX = VX << 1 (shiftl1), shift out to VF");
+				uint8_t tmp = VY;
+				VX = tmp << 1;
+				VF = tmp >> 7;
+			}
+			if (mode & (CHIP48 | SUPERCHIP))
+			{
+				//ignore VY
+				uint8_t tmp = VX;
+				VX = tmp << 1;
+				VF = tmp >> 7;
+			}
+			break;
+		default:
+			faults[FAULT_OPCODE]++; //not an instruction, likely data executed
+			break;
+		}
+		break;
+	case 0x9:
+		//printf("9XY0 if VX != VY, skip next instruction");
+		if (VX != VY) PC += 2;
+		break;
+	case 0xA:
+		//printf("ANNN set I to NNN");
+		I = NNN;
+		break;
+	case 0xB:
+		//printf("BNNN jump to address (V0+NNN)");
+		if (mode & (CHIP48 | SUPERCHIP)) jump(NNN + VX);	//BXNN: CHIP-48 and SUPER-CHIP add VX
+		if (mode & COSMACVIP) jump(NNN + V0);
+
+
+		break;
+	case 0xC:
+		//printf("CXNN set VX = rand0 & NN");
+		random ^= random << 13;	//xorshift32, state is part of the machine
+		random ^= random >> 17;
+		random ^= random << 5;
+		VX = uint8_t(random) & NN;	//low byte, all 256 values
+		break;
+	case 0xD:
+		//printf("DXYN draw sprite at (VX,VY), width 8 and height N");
+		draw<DEBUG>(VX, VY, N) ? VF = 0x01 : VF = 0x0;
+		break;
+	case 0xE:
+		switch (instruction & 0x00FF)
+		{
+		case 0x9E:
+			//printf("EX9E skip next instruction if key stored in VX pressed");
+			if (onKeyRead) onKeyRead(*this);
+			if (keyDown(VX))
+			{
+				PC += 2;
+				//printf("ex9e key pressed. skipping next\n");
+			}
+			break;
+		case 0xA1:
+			//printf("EXA1 skip next instruction if key stored in VX NOT pressed");
+			if (onKeyRead) onKeyRead(*this);
+			if (!keyDown(VX))
+			{
+				PC += 2;
+				//printf("exA1 key not pressed. skipping next\n");
+			}
+			break;
+		default:
+			faults[FAULT_OPCODE]++;
+			break;
+		}
+		break;
+	case 0xF:
+		switch (instruction & 0x00FF)
+		{
+		case 0x02:
+			//printf("F002 load the 16 byte audio pattern from I (XO-CHIP)");
+			if (X)
+			{
+				faults[FAULT_OPCODE]++;
+				break;
+			}
+			for (int i = 0; i < AUDIO_PATTERN_BYTES; ++i) audioPattern[i] = readRam<DEBUG>(I + i);
+			break;
+		case 0x07:
+			//printf("FX07 set VX to value of delay timer");
+			VX = timerDelay;
+			break;
+		case 0x0A:
+			//printf("FX0A wait keypress, store in VX (blocking) ");
+			/*
+			* state machine:
+			* //infinite loop until state machine complete
+			* 00 : wait press,
+			* |
+			* |any key down (keys != 0), remember it
+			* |
+			* V
+			* 01 : wait release / not wait press
+			* |
+			* |that key up ===> store in VX, escape loop
+			* |
+			* V
+			* 00
+			*/
+			//default state machine output : infinite loop
+			if (onKeyRead) onKeyRead(*this);
+			PC -= 2;
+			if (waitingKeyPress) //state 00
+			{
+				if (keys) //change state to 01, lowest key if several are down
+				{
+					waitedKey = 0;
+					while (!keyDown(waitedKey)) waitedKey++;
+					waitingKeyPress = false;
+				}
+			}
+			else //state 01 
+			{ //not waiting key press / waiting key release
+				if (!keyDown(waitedKey)) //that key released, others may still be down
+				{
+					VX = waitedKey; //store
+					PC += 2; //break from infinite loop ,escape
+					waitingKeyPress = true; // restore state machine , change back to 00
+				}
+			}
+			break;
+		case 0x15:
+			//printf("FX15 set timerDelay = VX");
+			timerDelay = VX;
+			break;
+		case 0x18:
+			//printf("FX18 set timerSound = %d\n", VX);
+			timerSound = VX;
+			break;
+		case 0x3A:
+			//printf("FX3A set audio pitch = VX (XO-CHIP)");
+			audioPitch = VX;
+			break;
+		case 0x1E:
+			//printf("FX1E I = I + VX , VF unchanged");
+			I += VX;
+			break;
+		case 0x29:
+			//printf("FX29 I = font[VX], set I to font sprite address stored in VX");
+			I = font(VX);
+			break;
+		case 0x33:
+			//printf("FX33 store BCD : 123 => I=1, I+1=2, I+2=3");
+		{
+			int value = VX;
+			for (int i = 2; i >= 0;--i) //2 1 0
+			{
+				writeRam<DEBUG>(I + i, value % 10);
+				value = value / 10;
+			}
+		}
+		break;
+		case 0x55:
+			for (int i = 0; i <= X; ++i)
+			{
+				//printf("FX55 store V0 to VX in memory from address I as offset (no change I)");
+				if (mode & COSMACVIP) writeRam<DEBUG>(I++, V[i]);
+				//printf("FX55 store V0 to VX in memory from address I as offset (increment I)");
+				if (mode & (CHIP48 | SUPERCHIP)) writeRam<DEBUG>(I + i, V[i]);
+			}
+			break;
+		case 0x65:
+			//printf("FX65 load V0 to VX from memory from address I as offset (no change in I)");
+			for (int i = 0; i <= X; ++i)
+			{
+				//printf("FX65 fill V0 to VX from memory from address I as offset (no change I)");
+				if (mode & COSMACVIP) V[i] = readRam<DEBUG>(I++);
+				//printf("FX65 fill V0 to VX from memory from address I as offset (increment I)");
+				if (mode & (CHIP48 | SUPERCHIP)) V[i] = readRam<DEBUG>(I + i);
+			}
+			break;
+		default:
+			faults[FAULT_OPCODE]++;
+			break;
+		}
+	default:
+		break;
+	}
+	//printf("VX:%2x, VY:%2x , VF:%2x\n", VX, VY, VF);
+}
+
+
+template <bool DEBUG>
+void Chip8::step()
+{
+	uint16_t pc = PC;
+	uint16_t instruction = fetch();
+	decodeandexecute<DEBUG>(instruction);
+	if (trace) trace[traceHead & traceMask] = TRACE_PACK(pc, instruction, I, VX, VF, stackPointer); //state after, see trace.h
+	traceHead++;
+}
+
+
+void Chip8::timerTick()
+{
+	if (timerDelay) timerDelay--;
+	if (timerSound) timerSound--;
+}
+
+
+void Chip8::runFrame(int cycles)
+{
+	for (int i = 0; i < cycles; ++i) step<false>();
+	timerTick();
+}
+
+
+void Chip8::push(uint16_t address)
+{
+	if (stackPointer < 255)
+	{
+		stack[++stackPointer] = address;
+	}
+	else faults[FAULT_STACK]++;
+}
+
+uint16_t Chip8::pop()
+{
+	if (stackPointer == 0) faults[FAULT_STACK]++; //00EE without a call, wraps
+	return stack[stackPointer--];
+}
+
+void Chip8::jump(uint16_t target)
+{
+	PC = target;
+	if (target < OFFSET_ROM || target > 0x0FFE) faults[FAULT_PC]++; //out of the program area, checked here and not per instruction
+}
+
+
+
+void Chip8::clearDisplay()
+{
+	for (int i = 0; i < 64; ++i)
+		for (int j = 0; j < 32; ++j)
+			vram[i][j] = 0;
+	vramVersion++;
+}
+
+
+bool Chip8::setPixel(uint8_t x, uint8_t y, bool bit)
+{
+	vram[x][y] ^= bit; //xor with new bit
+	return !vram[x][y] && bit; //return if flipped or not
+}
+
+
+template <bool DEBUG>
+bool Chip8::draw(uint8_t x, uint8_t y, uint8_t num)
+{
+	//wrap around start coordinate
+	x = x % CHIP8_DISPLAY_WIDTH;
+	y = y % CHIP8_DISPLAY_HEIGHT;
+
+	bool setToUnset = false; //set flag 0
+	vramVersion++;
+
+	//get 8 bit pixels data, 
+	//set at y pixel x to x+7 (increment x 1 at a time)
+	//increment y upto y+N-1, get next 8 bit pixel data
+	uint8_t pixel8 = 0;
+	for (int n = 0; n < num && (y + n) < CHIP8_DISPLAY_HEIGHT; ++n) //clip if boundary exceeded
+	{
+		pixel8 = readRam<DEBUG>(I + n);
+		for (int p = 0; p < 8 && (x + p) < CHIP8_DISPLAY_WIDTH; ++p)//clip if boundary exceeded
+		{
+			//if (setPixel(x + p, y + n, (pixel8 >> (7 - p)) & 0x1)) setToUnset = true;
+			setToUnset |= setPixel(x + p, y + n, (pixel8 >> (7 - p)) & 0x1);
+		}
+	}
+	return setToUnset;
+}
+
+
+uint64_t Chip8::vramHash() const
+{
+	return hashBytes(vram, sizeof(vram));
+}
+
+
+void Chip8::packRows(uint64_t rows[32]) const
+{
+	for (int y = 0; y < 32; ++y)
+	{
+		uint64_t row = 0;
+		for (int x = 0; x < 64; ++x) row = row << 1 | vram[x][y];
+		rows[y] = row;
+	}
+}
+
+
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash)
+{
+	const uint8_t* bytes = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i) hash = (hash ^ bytes[i]) * HASH_PRIME;
+	return hash;
+}
+
+
+//both engines
+template void Chip8::step<false>();
+template void Chip8::step<true>();
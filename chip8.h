@@ -0,0 +1,219 @@
+#pragma once
+
+/*
+* Chip8 machine, no SDL, no threads, no globals: everything one emulated chip needs.
+* The SDL frontend (main.cpp) owns one, headless tools (conformance) run many in parallel.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/*MACRO definitions**************************************************************************************************************************/
+
+/*chip modes*/
+#define COSMACVIP	0x1
+#define CHIP48		0x2
+#define SUPERCHIP	0x4
+#define CHIPMODE  COSMACVIP //default chip mode
+
+/*font address translation*/
+#define OFFSET_FONT			0x0050				//Address where font data begins
+#define BYTES_PER_FONT		5					//Each font sprite needs 5 byte
+#define font(x)				(OFFSET_FONT + ((x & 0x000F)*BYTES_PER_FONT)) //Get font x address
+
+/*load ROM*/
+#define OFFSET_ROM			0x0200	// Address where ROM data begins
+#define MAX_ROM_SIZE		(0x1000 - OFFSET_ROM)
+
+/*paged ram*/
+#define PAGE_SHIFT			8
+#define PAGE_SIZE			(1 << PAGE_SHIFT)	//256 bytes
+#define PAGE_COUNT			(4096 / PAGE_SIZE)	//16
+
+/*sound (XO-CHIP): a 128 bit pattern played at 4000*2^((pitch-64)/48) bits per second while timerSound runs*/
+#define AUDIO_PATTERN_BYTES		16
+#define AUDIO_PATTERN_DEFAULT	0xF0	//every byte until F002: 4 bits on, 4 off, a 500 Hz square (the old 480 Hz beep)
+#define AUDIO_PITCH_DEFAULT		64		//4000 bits per second
+
+/*display*/
+#define CHIP8_DISPLAY_WIDTH		64	//Chip8 screen width
+#define CHIP8_DISPLAY_HEIGHT	32	//Chip8 screen height
+
+/*watchpoint kinds*/
+#define WATCH_READ		0x1		//FX65, DXYN sprite data
+#define WATCH_WRITE		0x2		//FX33, FX55
+
+/*address bitmaps, one bit per ram byte*/
+#define DEBUG_BITMAP_WORDS	(4096 / 64)
+#define bitmapTest(map, address)	((map[((address) & 0x0FFF) >> 6] >> ((address) & 63)) & 1)
+
+/*faults, signs of a rom running in the wrong chip mode (or a broken rom)*/
+#define FAULT_STACK		0	//00EE with an empty stack, 2NNN with a full one
+#define FAULT_PC		1	//PC left the program area (BNNN, bad return address)
+#define FAULT_OPCODE	2	//no such instruction
+#define FAULT_COUNT		3
+
+/*opcode classes, how an instruction moves PC (static analysis), see opcodeClass()*/
+#define OP_INVALID		0	//not an instruction, FAULT_OPCODE
+#define OP_PLAIN		1	//next instruction follows (FX0A too, it repeats itself until a key)
+#define OP_SKIP			2	//3XNN 4XNN 5XYN 9XYN EX9E EXA1: next or the one after
+#define OP_JUMP			3	//1NNN
+#define OP_CALL			4	//2NNN, 0NNN
+#define OP_RETURN		5	//00EE
+#define OP_INDIRECT		6	//BNNN, target from a register
+
+/*hashing (FNV-1a 64)*/
+#define HASH_SEED		0xCBF29CE484222325ull
+#define HASH_PRIME		0x00000100000001B3ull
+
+/**Type Definitions********************************************************************************************************************/
+typedef uint8_t Reg8;	//8 bit reg
+typedef uint16_t Reg16; //16 bit reg
+
+/*
+* Copy on write ram:
+* pages are reference counted and shared between machines (clones, same rom),
+* a write to a shared page copies it first (FX33/FX55 only, rarely more than one page).
+* Unwritten pages all point to one zero page. Copying a Memory copies 16 pointers,
+* so a copy is the snapshot: pages still shared with it are the unchanged ones,
+* and assigning it back (reset, rewind) only touches the pages that differ.
+* Counts are atomic, machines sharing pages may run on different threads,
+* one Memory itself belongs to one thread.
+*/
+typedef struct Page
+{
+	std::atomic<uint32_t> refs;
+	uint8_t data[PAGE_SIZE];
+} Page;
+
+typedef struct Memory
+{
+	Page* pages[PAGE_COUNT];
+
+	Memory();					//all zero
+	Memory(const Memory& other);	//shares all pages
+	Memory& operator=(const Memory& other);	//shares other's pages, identical ones are skipped
+	~Memory();
+
+	uint8_t read(uint16_t address) const { return pages[(address >> PAGE_SHIFT) & (PAGE_COUNT - 1)]->data[address & (PAGE_SIZE - 1)]; }
+	void write(uint16_t address, uint8_t value) { writablePage((address >> PAGE_SHIFT) & (PAGE_COUNT - 1))[address & (PAGE_SIZE - 1)] = value; }
+	void load(uint16_t address, const uint8_t* data, size_t size);	//write a block (wraps at 4KB)
+	void copyTo(uint8_t out[4096]) const;	//flat image
+	void clear();				//back to the zero page everywhere
+
+	uint8_t* writablePage(int page)	//own the page (copy if shared)
+	{
+		if (pages[page]->refs.load(std::memory_order_acquire) != 1) ownPage(page);
+		return pages[page]->data;
+	}
+	void ownPage(int page);
+} Memory;
+
+typedef struct Chip8 Chip8;
+typedef void (*KeyReadHook)(Chip8& chip);	//called by EX9E/EXA1/FX0A when set
+
+struct Chip8
+{
+	/*Chip components*/
+	Memory ram;				//ram 4KB, copy on write pages
+	bool vram[64][32];		//display pixel data, 64x32 pixels
+	uint8_t stackPointer;	//max 255 (0-255)
+	uint16_t stack[256];	//stored addresses 16bit
+	Reg16 PC, I; 			//16-bit Program Counter and Index Register
+	Reg8 V[16];				//Register file with 16 general purpose registers 8 bit
+	Reg8 timerDelay;		//Down counter, 8 bit, 60 Hz
+	Reg8 timerSound;		//Down counter, 8 bit, 60 Hz, beep when non zero
+	uint8_t audioPattern[AUDIO_PATTERN_BYTES];	//F002, played MSB first, looped
+	uint8_t audioPitch;		//FX3A
+	uint8_t mode;			//quirks, COSMACVIP/CHIP48/SUPERCHIP
+	uint32_t random;		//CXNN generator state (xorshift), part of the machine so runs are repeatable
+
+	uint32_t faults[FAULT_COUNT];	//counted since clear(), the interpreter carries on
+
+	/*keys, FX0A statemachine*/
+	uint16_t keys;			//keypad, bit k set while key k is down (chords work)
+	uint8_t waitedKey;		//FX0A: key pressed, waiting for its release
+	bool waitingKeyPress;	//waiting for a key press
+	KeyReadHook onKeyRead;	//NULL, or called when an instruction looks at the keys
+
+	/*display changes*/
+	uint32_t vramVersion;	//incremented by every clear/draw
+
+	/*execution trace, see trace.h, ring size must be a power of 2*/
+	uint64_t* trace;		//ring, NULL: not recorded (copies of a machine share it, give clones their own or NULL)
+	uint64_t traceMask;
+	uint64_t traceHead;		//instructions executed
+
+	/*watchpoints, only looked at by the DEBUG engine*/
+	const uint64_t* watchRead;	//bitmaps owned by the debugger
+	const uint64_t* watchWrite;
+	bool watchHit;			//watched address touched by the instruction just executed
+	uint16_t watchAddress;
+	uint8_t watchKind;		//WATCH_READ or WATCH_WRITE
+
+	Chip8();
+
+	void clear();			//clear all register, ram, vram (mode, trace and hooks kept)
+	void loadFont();		//pre load font
+	size_t loadProgram(const uint8_t* rom, size_t size);	//copy rom to OFFSET_ROM, PC there, returns bytes loaded
+	void reset(const uint8_t* rom, size_t size);			//clear, font, program
+	void reset(const Memory& image);	//clear, then share the ram of an already loaded machine (font + program)
+
+	bool keyDown(uint8_t key) const { return (keys >> (key & 0x0F)) & 1; }
+
+	void push(uint16_t address);	//stack push
+	uint16_t pop();					//stack pop
+	void jump(uint16_t target);		//PC = target, FAULT_PC if outside the program area (1NNN, 2NNN/0NNN, BNNN, 00EE)
+
+	uint16_t fetch();				//fetch next rom instruction
+	template <bool DEBUG> uint8_t readRam(uint16_t address);				//data read, DEBUG engine checks watchpoints
+	template <bool DEBUG> void writeRam(uint16_t address, uint8_t value);	//data write, DEBUG engine checks watchpoints
+	template <bool DEBUG> void decodeandexecute(uint16_t instruction);	//decode and execute the instruction
+	template <bool DEBUG> void step();	//fetch, decode, execute, trace one instruction
+
+	void timerTick();				//60 Hz timer decrement
+	void runFrame(int cycles);		//headless: cycles instructions then one timer tick
+
+	void clearDisplay();	//clear vram
+	bool setPixel(uint8_t x, uint8_t y, bool bit);	//set pixel value by XORing bit with current pixel
+	template <bool DEBUG> bool draw(uint8_t x, uint8_t y, uint8_t num);	//set #num pixels from (x,y)
+	uint64_t vramHash() const;	//FNV-1a of the display
+	void packRows(uint64_t rows[32]) const;	//display as rows, rows[y] bit 63 is x=0
+};
+
+/*Functions***************************************************************************************************/
+uint64_t hashBytes(const void* data, size_t size, uint64_t hash = HASH_SEED);	//FNV-1a 64
+uint8_t opcodeClass(uint16_t instruction);	//OP_*, the same cases decodeandexecute() runs
+
+/*bit scans, GCC/Clang builtins, MSVC intrinsics (x64), plain C otherwise*/
+inline int popCount64(uint64_t bits)
+{
+#if defined(__GNUC__)
+	return __builtin_popcountll(bits);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	return (int)__popcnt64(bits);
+#else
+	int count = 0;
+	for (; bits; bits &= bits - 1) ++count;
+	return count;
+#endif
+}
+
+inline int lowestBit64(uint64_t bits)	//index of the lowest set bit, bits != 0
+{
+#if defined(__GNUC__)
+	return __builtin_ctzll(bits);
+#elif defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanForward64(&index, bits);
+	return (int)index;
+#else
+	int index = 0;
+	for (; !(bits & 1); bits >>= 1) ++index;
+	return index;
+#endif
+}
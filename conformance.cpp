@@ -0,0 +1,313 @@
+/*
+* conformance: run the test suite roms under every chip mode, headless and in parallel,
+* until the screen stops changing, and compare a hash of vram with the golden value.
+* usage: conformance [manifest] [--bless] [--allow-missing] [--threads n]
+*
+* manifest lines (# comments): <rom path> <chip mode> <keys|-> <golden hash|-> [<first row>-<last row> <quirk>]
+*	keys : hex keys pressed one after the other, each once the screen is stable (menus)
+*	hash : golden vram hash, - if not blessed yet
+*	rows : only these display rows are hashed, reported as the named quirk. Lines with the same rom,
+*	       mode and keys share one run, so one results screen gives a result per quirk.
+* --bless writes the hashes of this run back to the manifest (check the screens first).
+* A missing rom or a line without golden hash fails, unless --bless or --allow-missing.
+*/
+
+#include "chip8.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define CONFORMANCE_FILE	"conformance.txt"	//default manifest
+#define CYCLES_PER_FRAME	1000	//instructions per 60 Hz frame, fast enough for the suite, slow enough for its timers
+#define STABLE_FRAMES		30		//unchanged frames before the screen counts as final
+#define MAX_FRAMES			3000	//give up (50 s of emulated time)
+#define KEY_FRAMES			4		//frames a scripted key is held
+
+/*results*/
+#define RESULT_PASS		0
+#define RESULT_FAIL		1
+#define RESULT_NEW		2	//no golden hash yet
+#define RESULT_MISSING	3	//rom file not found
+#define RESULT_TIMEOUT	4	//screen never settled
+
+/**Type Definitions********************************************************************************************************************/
+
+typedef struct Test
+{
+	char rom[256];
+	int mode;
+	char keys[32];		//"" if none
+	uint64_t golden;
+	bool hasGolden;
+	int first, last;	//display rows hashed, 0-31 for the whole screen
+	char quirk[32];		//"" for the whole screen
+	const Memory* image;	//font + rom, shared by every test of the rom, NULL if missing
+	size_t run;			//test whose run gives the screen (same rom, mode and keys), itself if first
+
+	//filled by the worker
+	uint64_t hash;
+	int frames;
+	int result;
+} Test;
+
+
+//font + rom loaded once, tests share its ram pages until they write them
+Memory* loadImage(const char* filename)
+{
+	FILE* file = fopen(filename, "rb");
+	if (!file) return NULL;
+	uint8_t rom[MAX_ROM_SIZE];
+	size_t size = fread(rom, 1, sizeof(rom), file);
+	fclose(file);
+
+	Chip8 loader;
+	loader.reset(rom, size);
+	return new Memory(loader.ram);
+}
+
+
+//run tests[r] to a stable screen on its own Chip8 (only unwritten ram pages are shared), result of every test sharing the run
+void runTest(vector<Test>& tests, size_t r)
+{
+	const Test& test = tests[r];
+	Chip8* chip = NULL;
+	int result = RESULT_MISSING, frames = 0;
+	if (test.image)
+	{
+		chip = new Chip8(); //vram and stack, keep it off the worker stack
+		chip->mode = (uint8_t)test.mode;
+		chip->reset(*test.image);
+
+		const char* key = test.keys;
+		int held = 0, stable = 0;
+		uint32_t version = chip->vramVersion;
+		for (result = RESULT_TIMEOUT; frames < MAX_FRAMES && result == RESULT_TIMEOUT; ++frames)
+		{
+			chip->runFrame(CYCLES_PER_FRAME);
+			if (held && --held == 0) chip->keys = 0; //release, FX0A completes on release
+
+			stable = chip->vramVersion == version ? stable + 1 : 0;
+			version = chip->vramVersion;
+			if (stable < STABLE_FRAMES || held) continue;
+
+			if (*key)
+			{
+				//next menu choice
+				char digit[2] = { *key++, 0 };
+				chip->keys = 1 << strtol(digit, NULL, 16);
+				held = KEY_FRAMES;
+				stable = 0;
+				continue;
+			}
+			result = RESULT_PASS; //settled, compared below
+		}
+	}
+
+	uint64_t rows[32];
+	if (chip) chip->packRows(rows);
+	for (size_t i = r; i < tests.size(); ++i)
+	{
+		Test& t = tests[i];
+		if (t.run != r) continue;
+		t.frames = frames;
+		t.result = result;
+		if (result != RESULT_PASS) continue;
+		//whole screen: the hash otl_chip8_framebuffer_hash() gives, rows: FNV-1a of the packed rows
+		t.hash = t.quirk[0] ? hashBytes(rows + t.first, (t.last - t.first + 1) * sizeof(uint64_t)) : chip->vramHash();
+		t.result = !t.hasGolden ? RESULT_NEW : t.hash == t.golden ? RESULT_PASS : RESULT_FAIL;
+	}
+	delete chip;
+}
+
+
+//"<rom> <mode> <keys> <hash> [<rows> <quirk>]", false if the line is not a test
+bool parseTest(const char* line, Test& test)
+{
+	memset(&test, 0, sizeof(test));
+	char keys[32], hash[32], rows[16];
+	int fields = sscanf(line, "%255s %d %31s %31s %15s %31s", test.rom, &test.mode, keys, hash, rows, test.quirk);
+	if (fields != 4 && fields != 6) return false;
+	test.last = 31;
+	if (fields == 6 && (sscanf(rows, "%d-%d", &test.first, &test.last) != 2 || test.first < 0 || test.last > 31 || test.first > test.last)) return false;
+	if (strcmp(keys, "-")) strcpy(test.keys, keys);
+	test.hasGolden = strcmp(hash, "-") != 0;
+	if (test.hasGolden) test.golden = strtoull(hash, NULL, 16);
+	return true;
+}
+
+
+bool isComment(const char* line)
+{
+	return line[0] == '#' || line[strspn(line, " \t\r\n")] == 0;
+}
+
+
+bool readManifest(const char* filename, vector<Test>& tests)
+{
+	FILE* file = fopen(filename, "r");
+	if (!file) return false;
+
+	char line[512];
+	while (fgets(line, sizeof(line), file))
+	{
+		if (isComment(line)) continue;
+		Test test;
+		if (!parseTest(line, test))
+		{
+			printf("%s: bad line %s", filename, line);
+			continue;
+		}
+		tests.push_back(test);
+	}
+	fclose(file);
+	return true;
+}
+
+
+//rewrite the manifest line by line: comments and bad lines stay where they are, hashes of this run filled in (unknown ones left as they were)
+bool blessManifest(const char* filename, const vector<Test>& tests)
+{
+	FILE* file = fopen(filename, "r");
+	if (!file) return false;
+	vector<string> lines;
+	char line[512];
+	size_t t = 0;
+	while (fgets(line, sizeof(line), file))
+	{
+		Test parsed;
+		if (isComment(line) || !parseTest(line, parsed) || t >= tests.size())
+		{
+			lines.push_back(line);
+			continue;
+		}
+		const Test& test = tests[t++];
+		char hash[32] = "-", rows[64] = "\n";
+		if (test.result == RESULT_PASS || test.result == RESULT_FAIL || test.result == RESULT_NEW) snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)test.hash);
+		else if (test.hasGolden) snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)test.golden);
+		if (test.quirk[0]) snprintf(rows, sizeof(rows), " %d-%d %s\n", test.first, test.last, test.quirk);
+		snprintf(line, sizeof(line), "%s %d %s %s%s", test.rom, test.mode, test.keys[0] ? test.keys : "-", hash, rows);
+		lines.push_back(line);
+	}
+	fclose(file);
+
+	file = fopen(filename, "w");
+	if (!file) return false;
+	for (size_t i = 0; i < lines.size(); ++i) fputs(lines[i].c_str(), file);
+	return fclose(file) == 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+	const char* manifest = CONFORMANCE_FILE;
+	bool bless = false, allowMissing = false;
+	int threads = (int)thread::hardware_concurrency();
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--bless")) bless = true;
+		else if (!strcmp(argv[i], "--allow-missing")) allowMissing = true;
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+		else manifest = argv[i];
+	}
+	if (threads < 1) threads = 1;
+
+	vector<Test> tests;
+	if (!readManifest(manifest, tests))
+	{
+		printf("could not open %s\n", manifest);
+		return 1;
+	}
+
+	//one image per rom file, one run per rom, mode and keys
+	vector<Memory*> images;
+	vector<size_t> runs;
+	for (size_t i = 0; i < tests.size(); ++i)
+	{
+		size_t j = 0;
+		while (j < i && strcmp(tests[j].rom, tests[i].rom)) ++j;
+		if (j < i) tests[i].image = tests[j].image;
+		else if ((tests[i].image = loadImage(tests[i].rom))) images.push_back((Memory*)tests[i].image);
+
+		for (j = 0; j < i && (strcmp(tests[j].rom, tests[i].rom) || tests[j].mode != tests[i].mode || strcmp(tests[j].keys, tests[i].keys)); ++j);
+		tests[i].run = j < i ? tests[j].run : i;
+		if (tests[i].run == i) runs.push_back(i);
+	}
+
+	//workers take the next run until none left
+	auto start = chrono::steady_clock::now();
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	for (int t = 0; t < threads; ++t)
+		workers.push_back(thread([&]() { for (size_t i; (i = next++) < runs.size();) runTest(tests, runs[i]); }));
+	for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+	double ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+
+	//matrix: one row per rom (and quirk), one column per chip mode
+	const int modes[3] = { COSMACVIP, CHIP48, SUPERCHIP };
+	const char* modeNames[3] = { "COSMACVIP", "CHIP48", "SUPERCHIP" };
+	const char* resultNames[5] = { "pass", "FAIL", "new", "missing", "TIMEOUT" };
+	const char* failingNames[5] = { "pass", "FAIL", "NEW", "MISSING", "TIMEOUT" };	//new/missing counted as failures
+	int passed[3] = { 0 }, total[3] = { 0 }, failed = 0;
+
+	//not blessed yet or rom not there: nothing was tested, that fails too unless asked for
+	vector<bool> failing(tests.size());
+	for (size_t i = 0; i < tests.size(); ++i)
+	{
+		int result = tests[i].result;
+		failing[i] = result == RESULT_FAIL || result == RESULT_TIMEOUT || ((result == RESULT_NEW || result == RESULT_MISSING) && !bless && !allowMissing);
+		failed += failing[i];
+	}
+
+	//cells: result and frames until the screen settled
+	printf("%-44s %-18s %-18s %-18s\n", "rom", modeNames[0], modeNames[1], modeNames[2]);
+	vector<bool> shown(tests.size(), false);
+	for (size_t i = 0; i < tests.size(); ++i)
+	{
+		if (shown[i]) continue;
+		char label[300];
+		snprintf(label, sizeof(label), "%s%s%s", tests[i].rom, tests[i].quirk[0] ? " " : "", tests[i].quirk);
+		printf("%-44s", label);
+		for (int m = 0; m < 3; ++m)
+		{
+			char cell[32] = "";
+			for (size_t j = i; j < tests.size(); ++j)
+			{
+				if (shown[j] || tests[j].mode != modes[m] || strcmp(tests[j].rom, tests[i].rom) || strcmp(tests[j].quirk, tests[i].quirk)) continue;
+				shown[j] = true;
+				const Test& test = tests[j];
+				const char* name = (failing[j] ? failingNames : resultNames)[test.result];
+				if (test.result == RESULT_PASS || test.result == RESULT_FAIL || test.result == RESULT_NEW) snprintf(cell, sizeof(cell), "%s %d", name, test.frames);
+				else snprintf(cell, sizeof(cell), "%s", name);
+				passed[m] += test.result == RESULT_PASS;
+				total[m]++;
+				break;
+			}
+			printf(" %-18s", cell[0] ? cell : ".");
+		}
+		printf("\n");
+	}
+
+	printf("\n");
+	for (int m = 0; m < 3; ++m) printf("%s %d/%d passed\n", modeNames[m], passed[m], total[m]);
+	printf("%zu tests, %d threads, %.1f ms\n", tests.size(), threads, ms);
+
+	for (size_t i = 0; i < images.size(); ++i) delete images[i];
+
+	if (bless)
+	{
+		if (!blessManifest(manifest, tests)) printf("could not write %s\n", manifest);
+		else printf("hashes written to %s\n", manifest);
+		return 0;
+	}
+	if (failed) printf("%d failed%s\n", failed, allowMissing ? "" : " (missing roms and unblessed lines count, see --allow-missing)");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,364 @@
+#include "debugger.h"
+#include "disasm.h"
+#include <stdarg.h>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <string>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+typedef int SOCKET;
+#define INVALID_SOCKET	-1
+#define closesocket		close
+#endif
+
+
+/*set by command line*/
+int debugPort = 0;
+
+/*engine selection*/
+atomic<bool> debugEngine(false);
+
+/*emulation thread*/
+uint64_t breakpoints[DEBUG_BITMAP_WORDS];
+uint64_t watchRead[DEBUG_BITMAP_WORDS];
+uint64_t watchWrite[DEBUG_BITMAP_WORDS];
+int breakpointCount = 0;
+int watchpointCount = 0;
+
+bool debugPaused = false;	//stopped, waiting for commands
+bool debugResuming = false;	//continuing from a breakpoint, do not stop on it again
+int debugSteps = 0;			//instructions left before stopping
+int debugFrames = 0;		//frames left before stopping
+
+/*command queue, reader thread => emulation thread*/
+mutex debugMutex;
+condition_variable debugSignal;
+deque<string> debugCommands;
+atomic<bool> debugPending(false);
+atomic<intptr_t> debugClient(-1);	//connected socket, -1 prints to console
+
+
+void queueDebugCommand(const char* line)
+{
+	{
+		lock_guard<mutex> lock(debugMutex);
+		debugCommands.push_back(line);
+	}
+	debugPending = true;
+	debugEngine = true; //fast engine leaves its loop, the checking engine runs the command
+	debugSignal.notify_one();
+}
+
+
+void debugConsoleReader()
+{
+	char line[DEBUG_LINE_LENGTH];
+	while (fgets(line, sizeof(line), stdin)) queueDebugCommand(line);
+}
+
+
+void debugSocketReader()
+{
+#ifdef _WIN32
+	WSADATA wsa;
+	WSAStartup(MAKEWORD(2, 2), &wsa);
+#endif
+	SOCKET server = socket(AF_INET, SOCK_STREAM, 0);
+	int reuse = 1;
+	setsockopt(server, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse));
+
+	//local connections only
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_port = htons((uint16_t)debugPort);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	if (server == INVALID_SOCKET || bind(server, (sockaddr*)&address, sizeof(address)) || listen(server, 1))
+	{
+		printf("debugger could not listen on port %d\n", debugPort);
+		return;
+	}
+
+	//one client at a time, lines are commands
+	for (;;)
+	{
+		SOCKET client = accept(server, NULL, NULL);
+		if (client == INVALID_SOCKET) continue;
+		debugClient = (intptr_t)client;
+		debugPrint("otlchip8x debugger, h for help\n");
+
+		char buffer[DEBUG_LINE_LENGTH];
+		int length = 0;
+		int received;
+		while ((received = recv(client, buffer + length, sizeof(buffer) - 1 - length, 0)) > 0)
+		{
+			length += received;
+			buffer[length] = 0;
+
+			char* line = buffer;
+			char* end;
+			while ((end = strchr(line, '\n')) != NULL)
+			{
+				*end = 0;
+				queueDebugCommand(line);
+				line = end + 1;
+			}
+			length = (int)strlen(line);
+			memmove(buffer, line, length + 1);
+			if (length == sizeof(buffer) - 1) length = 0; //no newline in a full buffer, drop it
+		}
+
+		debugClient = -1;
+		closesocket(client);
+	}
+}
+
+
+void startDebugger(bool paused)
+{
+	debugPaused = paused;
+	if (paused) debugEngine = true;
+	chip8.watchRead = watchRead; //looked at by the checking engine only
+	chip8.watchWrite = watchWrite;
+
+	if (debugPort) printf("debugger listening on 127.0.0.1:%d\n", debugPort);
+	else printf("debugger on console, h for help\n");
+
+	//reader blocks in fgets/accept, never joined
+	thread(debugPort ? debugSocketReader : debugConsoleReader).detach();
+}
+
+
+void debugPrint(const char* format, ...)
+{
+	char text[1024];
+	va_list args;
+	va_start(args, format);
+	vsnprintf(text, sizeof(text), format, args);
+	va_end(args);
+
+	intptr_t client = debugClient;
+	if (client >= 0) send((SOCKET)client, text, (int)strlen(text), 0);
+	else
+	{
+		fputs(text, stdout);
+		fflush(stdout);
+	}
+}
+
+
+//stop and show where
+void debugStop(const char* reason)
+{
+	debugPaused = true;
+	debugSteps = 0;
+	debugFrames = 0;
+	uint16_t instruction = chip8.ram.read(chip8.PC) << 8 | chip8.ram.read(chip8.PC + 1);
+	char text[32];
+	disassemble(instruction, text, sizeof(text));
+	debugPrint("%s, PC %03X: %04X  %s\n", reason, chip8.PC, instruction, text);
+	if (chip8.vramVersion != publishedVersion) publishFrame(chip8); //show the screen as it is now
+}
+
+
+//set or clear an address bit, returns +1/-1/0 for counting
+int setBit(uint64_t* map, uint16_t address, bool set)
+{
+	uint64_t bit = 1ull << (address & 63);
+	uint64_t& word = map[(address & 0x0FFF) >> 6];
+	int change = set ? !(word & bit) : -(int)((word & bit) != 0);
+	set ? word |= bit : word &= ~bit;
+	return change;
+}
+
+
+void printBitmap(const char* name, uint64_t* map)
+{
+	for (int address = 0; address < 4096; ++address)
+		if (bitmapTest(map, address)) debugPrint("%s %03X\n", name, address);
+}
+
+
+void runDebugCommand(const char* line)
+{
+	char command[16] = "", first[16] = "", second[16] = "";
+	if (sscanf(line, "%15s %15s %15s", command, first, second) < 1) return;
+	uint16_t address = (uint16_t)strtoul(first, NULL, 16) & 0x0FFF;
+	int count = atoi(first);
+
+	switch (command[0])
+	{
+	case 'b':
+		//b addr : breakpoint, bd addr : delete
+		breakpointCount += setBit(breakpoints, address, command[1] != 'd');
+		debugPrint("%d breakpoints\n", breakpointCount);
+		break;
+	case 'w':
+		//w addr [r|w|rw] : watchpoint (default w), wd addr : delete
+		if (command[1] == 'd')
+		{
+			watchpointCount += setBit(watchRead, address, false);
+			watchpointCount += setBit(watchWrite, address, false);
+		}
+		else
+		{
+			if (strchr(second, 'r')) watchpointCount += setBit(watchRead, address, true);
+			if (strchr(second, 'w') || !second[0]) watchpointCount += setBit(watchWrite, address, true);
+		}
+		debugPrint("%d watchpoints\n", watchpointCount);
+		break;
+	case 'l':
+		printBitmap("break", breakpoints);
+		printBitmap("watch read", watchRead);
+		printBitmap("watch write", watchWrite);
+		break;
+	case 'c':
+		debugPaused = false;
+		debugResuming = true;
+		break;
+	case 'p':
+		debugStop("paused");
+		break;
+	case 's':
+		//s [n] : n instructions
+		debugSteps = count > 0 ? count : 1;
+		debugPaused = false;
+		debugResuming = true;
+		break;
+	case 'f':
+		//f [n] : to the end of n frames
+		debugFrames = count > 0 ? count : 1;
+		debugPaused = false;
+		debugResuming = true;
+		break;
+	case 'r':
+		debugPrint("PC %03X  I %03X  SP %02X  DT %02X  ST %02X  mode %d\n", chip8.PC, chip8.I, chip8.stackPointer, chip8.timerDelay, chip8.timerSound, chip8.mode);
+		for (int i = 0; i < 16; ++i) debugPrint("V%X %02X%s", i, chip8.V[i], i % 8 == 7 ? "\n" : "  ");
+		break;
+	case 'k':
+		//push pre-increments, stack[0] is never used
+		for (int i = chip8.stackPointer; i > 0; --i) debugPrint("%02X: %03X\n", i, chip8.stack[i]);
+		if (!chip8.stackPointer) debugPrint("stack empty\n");
+		break;
+	case 'm':
+	{
+		//m addr [length] : hex dump
+		int length = second[0] ? atoi(second) : 64;
+		for (int i = 0; i < length; i += 16)
+		{
+			debugPrint("%03X:", (address + i) & 0x0FFF);
+			for (int j = i; j < i + 16 && j < length; ++j) debugPrint(" %02X", chip8.ram.read(address + j));
+			debugPrint("\n");
+		}
+		break;
+	}
+	case 'v':
+		for (int y = 0; y < 32; ++y)
+		{
+			char row[65];
+			for (int x = 0; x < 64; ++x) row[x] = chip8.vram[x][y] ? '#' : '.';
+			row[64] = 0;
+			debugPrint("%s\n", row);
+		}
+		break;
+	case 'd':
+		//detach: drop everything and run at full speed
+		memset(breakpoints, 0, sizeof(breakpoints));
+		memset(watchRead, 0, sizeof(watchRead));
+		memset(watchWrite, 0, sizeof(watchWrite));
+		breakpointCount = watchpointCount = 0;
+		debugPaused = false;
+		debugResuming = true;
+		break;
+	default:
+		debugPrint(
+			"b addr       breakpoint at addr (hex)    bd addr   delete\n"
+			"w addr [rw]  watch ram reads/writes      wd addr   delete\n"
+			"l            list break/watchpoints\n"
+			"c            continue                    p         pause\n"
+			"s [n]        step n instructions         f [n]     run to end of n frames\n"
+			"r            registers                   k         stack\n"
+			"m addr [n]   dump n bytes of ram         v         vram\n"
+			"d            detach, clear all, continue\n");
+		break;
+	}
+}
+
+
+void runDebugCommands()
+{
+	for (;;)
+	{
+		string command;
+		{
+			lock_guard<mutex> lock(debugMutex);
+			if (debugCommands.empty())
+			{
+				debugPending = false;
+				break;
+			}
+			command = debugCommands.front();
+			debugCommands.pop_front();
+		}
+		bool wasPaused = debugPaused;
+		runDebugCommand(command.c_str());
+		if (wasPaused && !debugPaused) break; //resumed, later commands wait for the next stop
+	}
+
+	//nothing left to check, go back to the fast engine (unless a command just came in)
+	if (!debugPaused && !debugSteps && !debugFrames && !breakpointCount && !watchpointCount)
+	{
+		debugEngine = false;
+		if (debugPending) debugEngine = true;
+	}
+}
+
+
+bool debugBeforeExecute()
+{
+	if (debugPending && !debugSteps && !debugFrames) runDebugCommands(); //commands after s/f wait for it to stop
+
+	//paused: chip is frozen (timers too) until a command resumes it
+	while (debugPaused && !quit && !resetRequested)
+	{
+		{
+			unique_lock<mutex> lock(debugMutex);
+			debugSignal.wait_for(lock, chrono::milliseconds(DEBUG_WAIT_MS), [] { return !debugCommands.empty(); });
+		}
+		runDebugCommands();
+	}
+	if (debugPaused) return false;
+
+	if (!debugResuming && bitmapTest(breakpoints, chip8.PC))
+	{
+		debugStop("breakpoint");
+		return false;
+	}
+	return true;
+}
+
+
+void debugAfterExecute()
+{
+	debugResuming = false;
+	if (chip8.watchHit)
+	{
+		chip8.watchHit = false;
+		debugPrint("%s %03X\n", chip8.watchKind == WATCH_READ ? "read" : "write", chip8.watchAddress);
+		debugStop("watchpoint");
+	}
+	else if (debugSteps && --debugSteps == 0) debugStop("step");
+}
+
+
+void debugFrameEnd()
+{
+	if (debugFrames && --debugFrames == 0) debugStop("frame");
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include "main.h"
+
+/*MACRO definitions**************************************************************************************************************************/
+
+/*console/socket*/
+#define DEBUG_LINE_LENGTH	256		//longest command line
+#define DEBUG_WAIT_MS		10		//paused: wake up this often to see quit/reset
+
+/**Global Variables*********************************************************************************************************************/
+
+/*set by command line*/
+extern int debugPort;					//0: commands from console, else from a local socket on this port
+
+/*engine selection, the checking engine only runs while this is set*/
+extern atomic<bool> debugEngine;
+
+/*owned by emulation thread*/
+extern uint64_t breakpoints[DEBUG_BITMAP_WORDS];	//PC breakpoints
+extern uint64_t watchRead[DEBUG_BITMAP_WORDS];		//ram read watchpoints (chip8.watchRead points here)
+extern uint64_t watchWrite[DEBUG_BITMAP_WORDS];		//ram write watchpoints (chip8.watchWrite points here), hits are in chip8
+
+/*Functions***************************************************************************************************/
+void startDebugger(bool paused);	//start console/socket reader thread, optionally stop before the first instruction
+void debugPrint(const char* format, ...);	//print to console or connected socket client
+
+bool debugBeforeExecute();	//checking engine: run commands, wait while paused, stop on breakpoint, false if nothing to execute
+void debugAfterExecute();	//checking engine: stop on watchpoint or when single steps run out
+void debugFrameEnd();		//checking engine: run-to-frame countdown
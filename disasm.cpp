@@ -0,0 +1,82 @@
+#include "disasm.h"
+#include <stdio.h>
+
+
+void disassemble(uint16_t instruction, char* text, int length)
+{
+	//fields, same as the instruction extraction macros of chip8.cpp
+	int x = (instruction & 0x0F00) >> 8;
+	int y = (instruction & 0x00F0) >> 4;
+	int n = instruction & 0x000F;
+	int nn = instruction & 0x00FF;
+	int nnn = instruction & 0x0FFF;
+
+	switch (instruction >> 12)
+	{
+	case 0x0:
+		if (instruction == 0x00E0) snprintf(text, length, "CLS");
+		else if (instruction == 0x00EE) snprintf(text, length, "RET");
+		else snprintf(text, length, "SYS 0x%03X", nnn);
+		return;
+	case 0x1: snprintf(text, length, "JP 0x%03X", nnn); return;
+	case 0x2: snprintf(text, length, "CALL 0x%03X", nnn); return;
+	case 0x3: snprintf(text, length, "SE V%X, 0x%02X", x, nn); return;
+	case 0x4: snprintf(text, length, "SNE V%X, 0x%02X", x, nn); return;
+	case 0x5: snprintf(text, length, "SE V%X, V%X", x, y); return;	//N is not decoded, as in decodeandexecute()
+	case 0x6: snprintf(text, length, "LD V%X, 0x%02X", x, nn); return;
+	case 0x7: snprintf(text, length, "ADD V%X, 0x%02X", x, nn); return;
+	case 0x8:
+	{
+		const char* names[16] = { "LD", "OR", "AND", "XOR", "ADD", "SUB", "SHR", "SUBN", NULL, NULL, NULL, NULL, NULL, NULL, "SHL", NULL };
+		if (names[n]) { snprintf(text, length, "%s V%X, V%X", names[n], x, y); return; }
+		break;
+	}
+	case 0x9: snprintf(text, length, "SNE V%X, V%X", x, y); return;
+	case 0xA: snprintf(text, length, "LD I, 0x%03X", nnn); return;
+	case 0xB: snprintf(text, length, "JP V0, 0x%03X", nnn); return;
+	case 0xC: snprintf(text, length, "RND V%X, 0x%02X", x, nn); return;
+	case 0xD: snprintf(text, length, "DRW V%X, V%X, %d", x, y, n); return;
+	case 0xE:
+		if (nn == 0x9E) { snprintf(text, length, "SKP V%X", x); return; }
+		if (nn == 0xA1) { snprintf(text, length, "SKNP V%X", x); return; }
+		break;
+	case 0xF:
+		switch (nn)
+		{
+		case 0x02: if (x == 0) { snprintf(text, length, "LD AUDIO, [I]"); return; } break;
+		case 0x07: snprintf(text, length, "LD V%X, DT", x); return;
+		case 0x0A: snprintf(text, length, "LD V%X, K", x); return;
+		case 0x15: snprintf(text, length, "LD DT, V%X", x); return;
+		case 0x18: snprintf(text, length, "LD ST, V%X", x); return;
+		case 0x1E: snprintf(text, length, "ADD I, V%X", x); return;
+		case 0x29: snprintf(text, length, "LD F, V%X", x); return;
+		case 0x33: snprintf(text, length, "LD B, V%X", x); return;
+		case 0x3A: snprintf(text, length, "LD PITCH, V%X", x); return;
+		case 0x55: snprintf(text, length, "LD [I], V%X", x); return;
+		case 0x65: snprintf(text, length, "LD V%X, [I]", x); return;
+		}
+		break;
+	}
+	snprintf(text, length, "DW 0x%04X", instruction);
+}
+
+
+int instructionTarget(uint16_t instruction)
+{
+	int x = (instruction & 0x0F00) >> 8;
+	switch (instruction >> 12)
+	{
+	case 0x6: case 0x7: case 0x8: case 0xC:
+		return x;
+	case 0xA:
+		return TARGET_I;
+	case 0xF:
+		switch (instruction & 0x00FF)
+		{
+		case 0x07: case 0x0A: case 0x65: return x;
+		case 0x1E: case 0x29: return TARGET_I;
+		}
+		break;
+	}
+	return TARGET_NONE;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+/*
+* Disassembler, shared by the debugger and tracedecode (no SDL).
+* Mnemonics follow Cowgod's Chip-8 technical reference.
+*/
+
+#include <stdint.h>
+
+/*MACRO definitions**************************************************************************************************************************/
+
+/*register written by an instruction*/
+#define TARGET_NONE		-1		//no register (or only VF/PC/stack/ram)
+#define TARGET_I		16		//index register, 0-15 are V0-VF
+
+/*Functions***************************************************************************************************/
+void disassemble(uint16_t instruction, char* text, int length);	//mnemonic and operands, "DW" if not an instruction
+int instructionTarget(uint16_t instruction);	//register the instruction writes: 0-15 (VX), TARGET_I or TARGET_NONE
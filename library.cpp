@@ -0,0 +1,261 @@
+#include "library.h"
+#include "chip8.h"
+#include "quirks.h"
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+
+bool openLibrary(Library& library, const char* filename)
+{
+	memset(&library, 0, sizeof(library));
+#ifdef _WIN32
+	HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	HANDLE handle = NULL;
+	if (GetFileSizeEx(file, &size) && size.QuadPart >= (LONGLONG)sizeof(LibraryHeader)) handle = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	CloseHandle(file); //the mapping keeps it open
+	if (!handle) return false;
+	void* mapping = MapViewOfFile(handle, FILE_MAP_READ, 0, 0, 0);
+	if (!mapping)
+	{
+		CloseHandle(handle);
+		return false;
+	}
+	library.mappingHandle = handle;
+	size_t mappedSize = (size_t)size.QuadPart;
+#else
+	int file = open(filename, O_RDONLY);
+	if (file < 0) return false;
+	struct stat status;
+	void* mapping = MAP_FAILED;
+	if (fstat(file, &status) == 0 && status.st_size >= (off_t)sizeof(LibraryHeader)) mapping = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	close(file); //the mapping keeps it open
+	if (mapping == MAP_FAILED) return false;
+	size_t mappedSize = (size_t)status.st_size;
+#endif
+	library.mapping = mapping;
+	library.mappedSize = mappedSize;
+
+	//everything the header promises must be in the file, the last string terminated
+	const LibraryHeader* header = (const LibraryHeader*)mapping;
+	size_t entriesSize = (size_t)header->count * sizeof(LibraryEntry);
+	bool valid = !memcmp(header->magic, LIBRARY_MAGIC, 4) && header->version == LIBRARY_VERSION
+		&& mappedSize == sizeof(LibraryHeader) + entriesSize + header->stringsSize
+		&& (header->stringsSize == 0 || ((const char*)mapping)[mappedSize - 1] == 0);
+	if (!valid)
+	{
+		closeLibrary(library);
+		return false;
+	}
+	library.header = header;
+	library.entries = (const LibraryEntry*)(header + 1);
+	library.strings = (const char*)(library.entries + header->count);
+	return true;
+}
+
+
+void closeLibrary(Library& library)
+{
+	if (library.mapping)
+	{
+#ifdef _WIN32
+		UnmapViewOfFile(library.mapping);
+		CloseHandle(library.mappingHandle);
+#else
+		munmap(library.mapping, library.mappedSize);
+#endif
+	}
+	memset(&library, 0, sizeof(library));
+}
+
+
+const char* libraryPath(const Library& library, const LibraryEntry& entry)
+{
+	return entry.path < library.header->stringsSize ? library.strings + entry.path : "";
+}
+
+
+typedef struct ScanFile
+{
+	string path;
+	int64_t modified;
+	uint32_t size;
+	LibraryEntry entry;		//path offset filled when written
+	int state;				//SCAN_*
+} ScanFile;
+
+#define SCAN_UNCHANGED	0
+#define SCAN_PENDING	1	//to be read by a worker
+#define SCAN_RENAMED	2
+#define SCAN_DETECTED	3
+#define SCAN_UNREADABLE	4	//left out
+
+
+static bool romExtension(const string& path)
+{
+	const char* extensions[] = LIBRARY_EXTENSIONS;
+	size_t dot = path.find_last_of('.');
+	if (dot == string::npos || path.find_first_of("/\\", dot) != string::npos) return false;
+	string extension = path.substr(dot);
+	for (size_t i = 0; i < extension.size(); ++i) extension[i] = (char)tolower((unsigned char)extension[i]);
+	for (size_t i = 0; i < sizeof(extensions) / sizeof(extensions[0]); ++i)
+		if (extension == extensions[i]) return true;
+	return false;
+}
+
+
+//worker: read and hash, contents known from the old index are not run again
+static void scanRom(ScanFile& rom, const unordered_map<uint64_t, const LibraryEntry*>& known)
+{
+	FILE* file = fopen(rom.path.c_str(), "rb");
+	if (!file)
+	{
+		rom.state = SCAN_UNREADABLE;
+		return;
+	}
+	uint8_t program[MAX_ROM_SIZE];
+	size_t size = fread(program, 1, sizeof(program), file); //as loadProgram() reads it, same hash as quirks.db
+	fclose(file);
+
+	memset(&rom.entry, 0, sizeof(rom.entry));
+	rom.entry.hash = hashBytes(program, size);
+	auto found = known.find(rom.entry.hash);
+	if (found != known.end())
+	{
+		rom.entry.mode = found->second->mode;
+		memcpy(rom.entry.thumbnail, found->second->thumbnail, sizeof(rom.entry.thumbnail));
+		rom.state = SCAN_RENAMED;
+	}
+	else
+	{
+		rom.entry.mode = detectModeSerial(program, size, rom.entry.thumbnail);
+		rom.state = SCAN_DETECTED;
+	}
+}
+
+
+bool scanLibrary(const char* filename, const char* const* dirs, int dirCount, int threads, LibraryScan& scan)
+{
+	auto start = chrono::steady_clock::now();
+	memset(&scan, 0, sizeof(scan));
+
+	//rom files under dirs, path order
+	vector<ScanFile> roms;
+	for (int d = 0; d < dirCount; ++d)
+	{
+		error_code error;
+		for (filesystem::recursive_directory_iterator it(dirs[d], filesystem::directory_options::skip_permission_denied, error), end; !error && it != end; it.increment(error))
+		{
+			string path = it->path().string();
+			struct stat status;
+			if (!romExtension(path) || stat(path.c_str(), &status) || !S_ISREG(status.st_mode) || status.st_size == 0) continue;
+			ScanFile rom;
+			rom.path = path;
+			rom.modified = (int64_t)status.st_mtime;
+			rom.size = (uint32_t)status.st_size;
+			rom.state = SCAN_PENDING;
+			roms.push_back(rom);
+		}
+		if (error) printf("library: %s: %s\n", dirs[d], error.message().c_str());
+	}
+	sort(roms.begin(), roms.end(), [](const ScanFile& a, const ScanFile& b) { return a.path < b.path; });
+	roms.erase(unique(roms.begin(), roms.end(), [](const ScanFile& a, const ScanFile& b) { return a.path == b.path; }), roms.end());
+
+	//same path, size and mtime as in the old index: taken as it is, the file is not read
+	Library old;
+	unordered_map<uint64_t, const LibraryEntry*> known;
+	if (openLibrary(old, filename))
+	{
+		const LibraryEntry* entries = old.entries;
+		uint32_t count = old.header->count;
+		for (uint32_t i = 0; i < count; ++i) known[entries[i].hash] = &entries[i];
+		uint32_t o = 0;
+		for (size_t r = 0; r < roms.size(); ++r)
+		{
+			//both sorted by path, walk them together
+			while (o < count && strcmp(libraryPath(old, entries[o]), roms[r].path.c_str()) < 0) ++o;
+			if (o == count) break;
+			const LibraryEntry& entry = entries[o];
+			if (roms[r].path != libraryPath(old, entry) || entry.size != roms[r].size || entry.modified != roms[r].modified) continue;
+			roms[r].entry = entry;
+			roms[r].state = SCAN_UNCHANGED;
+		}
+	}
+
+	//the rest in parallel, each worker takes the next pending rom
+	if (threads < 1) threads = (int)thread::hardware_concurrency();
+	if (threads < 1) threads = 1;
+	atomic<size_t> next(0);
+	vector<thread> workers;
+	for (int t = 0; t < threads; ++t)
+		workers.push_back(thread([&]() { for (size_t i; (i = next++) < roms.size();) if (roms[i].state == SCAN_PENDING) scanRom(roms[i], known); }));
+	for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+	closeLibrary(old); //before replacing the file (windows)
+
+	//new index next to the old one, then renamed over it: readers never see half a file
+	string temporary = string(filename) + ".tmp";
+	FILE* file = fopen(temporary.c_str(), "wb");
+	if (!file) return false;
+	vector<LibraryEntry> entries;
+	string strings;
+	vector<uint64_t> hashes;
+	vector<uint8_t> modes;
+	for (size_t r = 0; r < roms.size(); ++r)
+	{
+		ScanFile& rom = roms[r];
+		if (rom.state == SCAN_UNREADABLE) continue;
+		rom.entry.modified = rom.modified;
+		rom.entry.size = rom.size;
+		rom.entry.path = (uint32_t)strings.size();
+		strings.append(rom.path.c_str(), rom.path.size() + 1);
+		entries.push_back(rom.entry);
+		scan.unchanged += rom.state == SCAN_UNCHANGED;
+		scan.renamed += rom.state == SCAN_RENAMED;
+		if (rom.state == SCAN_DETECTED)
+		{
+			scan.detected++;
+			hashes.push_back(rom.entry.hash);
+			modes.push_back(rom.entry.mode);
+		}
+	}
+	LibraryHeader header;
+	memcpy(header.magic, LIBRARY_MAGIC, 4);
+	header.version = LIBRARY_VERSION;
+	header.count = (uint32_t)entries.size();
+	header.stringsSize = (uint32_t)strings.size();
+	fwrite(&header, sizeof(header), 1, file);
+	if (!entries.empty()) fwrite(entries.data(), sizeof(LibraryEntry), entries.size(), file);
+	fwrite(strings.data(), 1, strings.size(), file);
+	if (fclose(file)) return false;
+	error_code error;
+	filesystem::rename(temporary, filename, error);
+	if (error) return false;
+
+	//otlchip8x in auto mode finds them without detecting again
+	if (!hashes.empty()) storeModes(hashes.data(), modes.data(), hashes.size());
+
+	scan.roms = (int)entries.size();
+	scan.ms = chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+	return true;
+}
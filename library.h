@@ -0,0 +1,77 @@
+#pragma once
+
+/*
+* Rom library: an index of the roms found in some directories, with hash, chip mode and a thumbnail each.
+* Scanning runs new roms headless in parallel (mode detection, see quirks.h), unchanged files
+* (same path, size and mtime) are taken from the old index without being read.
+* The index file is used in place (memory mapped), opening it reads nothing but the header.
+* No SDL here.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define LIBRARY_FILE		"library.idx"	//default index
+#define LIBRARY_MAGIC		"C8LB"
+#define LIBRARY_VERSION		1
+#define LIBRARY_EXTENSIONS	{ ".ch8", ".c8", ".sc8", ".xo8" }	//rom files, case ignored
+
+/**Type Definitions********************************************************************************************************************/
+
+/*
+* index file:
+* header
+* entries[count], sorted by path
+* path strings, NUL terminated, entry.path is an offset from the start of the strings
+*/
+typedef struct LibraryHeader
+{
+	char magic[4];		//LIBRARY_MAGIC
+	uint32_t version;	//LIBRARY_VERSION
+	uint32_t count;		//entries
+	uint32_t stringsSize;
+} LibraryHeader;
+
+typedef struct LibraryEntry
+{
+	uint64_t hash;			//FNV-1a of the rom (quirks.db key)
+	int64_t modified;		//mtime at scan
+	uint32_t size;			//bytes
+	uint32_t path;			//string offset
+	uint8_t mode;			//detected chip mode
+	uint8_t reserved[7];
+	uint64_t thumbnail[32];	//packed rows (Chip8::packRows), busiest screen seen during detection
+} LibraryEntry;				//296 bytes
+
+typedef struct Library
+{
+	const LibraryHeader* header;	//NULL if not open
+	const LibraryEntry* entries;
+	const char* strings;
+	void* mapping;			//whole file
+	size_t mappedSize;
+#ifdef _WIN32
+	void* mappingHandle;
+#endif
+} Library;
+
+typedef struct LibraryScan
+{
+	int roms;		//in the index now
+	int unchanged;	//taken from the old index as they were
+	int renamed;	//new path or touched file, known contents (hash in the old index), not run again
+	int detected;	//run headless
+	double ms;
+} LibraryScan;
+
+/*Functions***************************************************************************************************/
+
+bool openLibrary(Library& library, const char* filename);	//map the index, false if missing or not a valid index
+void closeLibrary(Library& library);
+const char* libraryPath(const Library& library, const LibraryEntry& entry);
+
+//scan dirs (recursively) against the index in filename and write it again, threads 0: all cores.
+//Newly detected modes are added to quirks.db. false if the index could not be written.
+bool scanLibrary(const char* filename, const char* const* dirs, int dirCount, int threads, LibraryScan& scan);
@@ -1,32 +1,36 @@
 #include "main.h"
+#include "debugger.h"
+#include "trace.h"
+#include "quirks.h"
+#include "browser.h"
 #include <iostream>
+#include <vector>
+#include <sys/stat.h>
 
 
 /**	offline configuration **/
-uint8_t mode;
 int scaleFactor;
 int displayWidth;
 int displayHeight;
 int enableDelay;
 int frequencyTimer;
 int frameRate;
+uint8_t chipMode;
+int runAhead;
 int frequencyCPU;
+int presentMode;
+int latencyStats;
+int scaleFilter;
 
 
-/*Chip components*/
-uint8_t ram[4096];		//ram 4KB
-bool vram[64][32];		//display pixel data, 64x32 pixels
-uint8_t stackPointer;	//max 255 (0-255)
-uint16_t stack[256];	//stored addresses 16bit
-Reg16 PC, I; 			//16-bit Program Counter and Index Register
-Reg8 V[16];				//Register file with 16 general purpose registers 8 bit
-Reg8 timerDelay;		//Down counter, 8 bit, 60 Hz
-Reg8 timerSound;		//Down counter, 8 bit, 60 Hz, beep when non zero
+/*the chip, see chip8.h, only the emulation thread touches it*/
+Chip8 chip8;
 
 
 /*timing*/
 uint32_t lastFrameUpdate = 0;
-uint32_t lastTimerUpdate = 0;
+uint32_t timerStart = 0;
+uint64_t timerTicks = 0;
 uint32_t lastCPUExecute = 0;
 
 
@@ -34,31 +38,103 @@ uint32_t lastCPUExecute = 0;
 /*display*/
 SDL_Window* window = NULL;
 SDL_Renderer* renderer = NULL;
+SDL_Texture* texture = NULL;
+int textureScale = 0;
 
 /*audio*/
-SDL_AudioSpec spec;		//beep tone spec
-SDL_AudioDeviceID dev;	//audio device
-WAVE_DATA_TYPE wave[WAVE_LENGTH];	//beep data one wavelength(cycle)
+SDL_AudioSpec spec;		//as obtained
+SDL_AudioDeviceID dev = 0;	//audio device
+atomic<uint8_t> audioState(AUDIO_CLOSED);
+AudioMixer mixer;
+AudioVoice voice;
+uint8_t audioBuffer[AUDIO_MAX_TICK * 8 * 4];
 
 /*keypress*/
-bool keyIsPressed = false;
-bool waitingKeyPress = true;
-uint8_t pressedKeyHex = 0x00;
+KeyEvent keyQueue[KEY_QUEUE_SIZE];
+atomic<uint32_t> keyQueueHead(0);
+atomic<uint32_t> keyQueueTail(0);
+atomic<uint16_t> keysLatest(0);
+atomic<bool> keyQueueOverflow(false);
+uint16_t keysReleasing = 0;
 
 /*events (keypress or close)*/
 SDL_Event e;
-bool quit = false;
+atomic<bool> quit(false);
+atomic<bool> traceOnQuit(false);
+atomic<bool> resetRequested(false);
+
+/*run ahead*/
+Chip8 aheadChip;
+int frameCycles = 0;
+int aheadCycles = 0;
+
+/*frame handoff*/
+Frame frames[FRAME_BUFFERS];
+uint8_t frameBack = 0;
+atomic<uint8_t> frameReady(1);
+uint8_t frameFront = 2;
+uint32_t publishedVersion = 0;
+bool frameSkipped = false;
+
+/*input latency*/
+uint64_t keyEventTime = 0;
+uint64_t latencyEventTime = 0;
+uint64_t latencyObserveTime = 0;
+bool latencyArmed = false;
+uint32_t latencyVersion = 0;
+uint64_t latencyHistogram[3][LATENCY_BUCKETS];
+uint64_t latencySum[3];
+
+/*present timing*/
+uint64_t lastRenderCost = 0;
+uint64_t lastPresentTime = 0;
 /***************************************/
 
 const char* romFilename;
 
+/*startup/reset*/
+uint8_t detectedMode = 0;
+Memory pristineRam;
+bool pristineValid = false;
+FileStamp configStamp;
+FileStamp romStamp;
+uint64_t startupTime;
+uint64_t resetRequestTime;
+
 int main(int argc, char* argv[])
 {
+	startupTime = SDL_GetPerformanceCounter();
+	if (argc < 2)
+	{
+		printf("usage: otlchip8x <rom> [--debug | --debug-port <port>]\n       otlchip8x --library [rom dir ...] [--debug | --debug-port <port>]\n");
+		return 1;
+	}
 	romFilename = argv[1];
+	bool library = !strcmp(argv[1], "--library");
+	chip8.trace = traceRing;
+	chip8.traceMask = TRACE_MASK;
+	installTraceHandlers();
+
+	//options after the rom: --debug (console) or --debug-port <port> (local socket), starts paused
+	//after --library anything else is a directory to scan
+	bool debug = false;
+	vector<const char*> libraryDirs;
+	for (int i = 2; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--debug")) debug = true;
+		else if (!strcmp(argv[i], "--debug-port") && i + 1 < argc)
+		{
+			debug = true;
+			debugPort = atoi(argv[++i]);
+		}
+		else if (library) libraryDirs.push_back(argv[i]);
+	}
 
-	init();
-	//prepare screen
-	if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO))
+	//library: only the config before the window (its size), the rom once picked
+	if (!library) init();
+	else if (fileChanged("config.txt", configStamp)) loadConfig();
+	//prepare screen, audio is opened by run() before the emulation thread starts
+	if (SDL_Init(SDL_INIT_VIDEO))
 	{
 		printf("SDL failed to initialize : %s\n", SDL_GetError());
 		return -1;
@@ -66,12 +142,28 @@ int main(int argc, char* argv[])
 
 	initDisplay();
 
-	initAudio();
+	if (library)
+	{
+		romFilename = browseLibrary(libraryDirs.data(), (int)libraryDirs.size());
+		if (romFilename)
+		{
+			init();
+			startupTime = SDL_GetPerformanceCounter(); //from the pick
+		}
+		else quit = true; //nothing picked, run() returns at once
+	}
+
+	if (debug && !quit) startDebugger(true);
 
 	//loop
 	run();
 
+	if (traceOnQuit) dumpTrace(TRACE_REASON_QUIT); //emulation thread stopped, ring is complete
+
+	if (latencyStats) reportLatency();
+
 	//close
+	if (texture) SDL_DestroyTexture(texture);
 	SDL_DestroyRenderer(renderer);
 	SDL_DestroyWindow(window);
 	SDL_Quit();
@@ -79,59 +171,6 @@ int main(int argc, char* argv[])
 	return 0;
 }
 
-void chip8Clear()
-{
-	//set all to 0
-	mode = 0;
-
-	for (int i = 0; i < 4096; ++i)
-		ram[i] = 0;
-
-	for (int i = 0; i < 64; ++i)
-		for (int j = 0; j < 32; ++j)
-			vram[i][j] = 0;
-
-	stackPointer = 0;
-
-	for (int i = 0; i < 256; ++i)
-		stack[i] = 0;
-
-	PC = 0;
-
-	I = 0;
-
-	for (int i = 0; i < 16; ++i)
-		V[i] = 0;
-
-	timerDelay = 0;
-
-	timerSound = 0;
-}
-
-void loadFont()
-{
-	uint8_t  font[] = {
-		0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-		0x20, 0x60, 0x20, 0x20, 0x70, // 1
-		0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-		0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-		0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-		0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-		0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-		0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-		0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-		0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-		0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-		0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-		0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-		0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-		0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-		0xF0, 0x80, 0xF0, 0x80, 0x80  // F
-	};
-	for (int i = 0; i < 80; ++i) ram[OFFSET_FONT + i] = font[i];
-}
-
-
 void loadConfig()
 {
 	//set default values
@@ -141,8 +180,12 @@ void loadConfig()
 	enableDelay = ENABLE_DELAY;
 	frequencyTimer = FREQUENCY_TIMER;
 	frameRate = FRAME_RATE;
+	runAhead = RUN_AHEAD;
 	frequencyCPU = FREQUENCY_CPU;
-	mode = CHIPMODE;
+	chipMode = CHIPMODE;
+	presentMode = PRESENT_MODE;
+	latencyStats = LATENCY_STATS;
+	scaleFilter = SCALE_FILTER;
 
 	FILE* config = fopen("config.txt", "r");
 	if (config == NULL)//create if does not exist
@@ -154,26 +197,44 @@ void loadConfig()
 		fprintf(config, "%s %d\n", "ENABLE_DELAY", enableDelay);
 		fprintf(config, "%s %d\n", "FREQUENCY_CPU", frequencyCPU);
 		fprintf(config, "%s %d\n", "SCALE_FACTOR", scaleFactor);
+		fprintf(config, "%s %d\n", "SCALE_FILTER", scaleFilter);
 		fprintf(config, "%s %d\n", "FRAME_RATE", frameRate);
-		fprintf(config, "%s %hhu\n", "CHIP_MODE", mode);
+		fprintf(config, "%s %d\n", "RUN_AHEAD", runAhead);
+		fprintf(config, "%s %hhu\n", "CHIP_MODE", chipMode);
+		fprintf(config, "%s %d\n", "PRESENT_MODE", presentMode);
+		fprintf(config, "%s %d\n", "LATENCY_STATS", latencyStats);
 		fclose(config);
 
 		config = fopen("config.txt", "r");
 	}
 
-	fscanf(config, "%*s %d", &enableDelay);
-	fscanf(config, "%*s %d", &frequencyCPU);
-	fscanf(config, "%*s %d", &scaleFactor);
-	fscanf(config, "%*s %d", &frameRate);
-	fscanf(config, "%*s %hhu", &mode);
+	//"NAME value" pairs, any order, missing ones keep their default (older config files still work)
+	char name[64];
+	int value;
+	while (fscanf(config, "%63s %d", name, &value) == 2)
+	{
+		if (!strcmp(name, "ENABLE_DELAY")) enableDelay = value;
+		else if (!strcmp(name, "FREQUENCY_CPU")) frequencyCPU = value;
+		else if (!strcmp(name, "SCALE_FACTOR")) scaleFactor = value;
+		else if (!strcmp(name, "SCALE_FILTER")) scaleFilter = value;
+		else if (!strcmp(name, "FRAME_RATE")) frameRate = value;
+		else if (!strcmp(name, "RUN_AHEAD")) runAhead = value;
+		else if (!strcmp(name, "CHIP_MODE")) chipMode = (uint8_t)value;
+		else if (!strcmp(name, "PRESENT_MODE")) presentMode = value;
+		else if (!strcmp(name, "LATENCY_STATS")) latencyStats = value;
+	}
 
 	fclose(config);
 
 	printf("%s %d\n", "ENABLE_DELAY", enableDelay);
 	printf("%s %d\n", "FREQUENCY_CPU", frequencyCPU);
 	printf("%s %d\n", "SCALE_FACTOR", scaleFactor);
+	printf("%s %d\n", "SCALE_FILTER", scaleFilter);
 	printf("%s %d\n", "FRAME_RATE", frameRate);
-	printf("%s %d\n", "CHIP_MODE", mode);
+	printf("%s %d\n", "RUN_AHEAD", runAhead);
+	printf("%s %d\n", "CHIP_MODE", chipMode);
+	printf("%s %d\n", "PRESENT_MODE", presentMode);
+	printf("%s %d\n", "LATENCY_STATS", latencyStats);
 }
 
 
@@ -214,108 +275,157 @@ void loadProgram()
 	//file containing program hex
 	FILE* rom = fopen(romFilename, "rb");
 
-	//place starting at rom offset
-	uint16_t address = OFFSET_ROM;
-	char instruction = 0;
-	uint8_t i = 0;
+	//place starting at rom offset, PC there
+	uint8_t program[MAX_ROM_SIZE];
+	size_t size = 0;
 	if (rom)
 	{
-		fread(ram + OFFSET_ROM, 1, 0x0FFF - OFFSET_ROM, rom);
+		size = fread(program, 1, sizeof(program), rom);
 		fclose(rom);
 	}
+	else printf("could not open %s, running an empty program\n", romFilename);
+	chip8.loadProgram(program, size);
 
-	//update PC
-	PC = OFFSET_ROM;
+	//CHIP_MODE 0: mode from quirks.db or detected (then stored there)
+	detectedMode = 0;
+	if (!chipMode)
+	{
+		bool cached;
+		uint64_t scores[3];
+		uint64_t start = SDL_GetPerformanceCounter();
+		detectedMode = autoMode(program, size, &cached, scores);
+		printf("CHIP_MODE auto: %d (%s, %.1f ms)\n", detectedMode, cached ? QUIRKS_FILE : "detected",
+			(SDL_GetPerformanceCounter() - start) * 1000.0 / SDL_GetPerformanceFrequency());
+		if (!cached) printf("mode scores (lower is better): COSMACVIP %llu, CHIP48 %llu, SUPERCHIP %llu\n",
+			(unsigned long long)scores[0], (unsigned long long)scores[1], (unsigned long long)scores[2]);
+	}
 }
 
 
 void init()
 {
-	chip8Clear();
-	loadConfig();
-	loadFont();
-	loadProgram();
+	/*
+	* Reset does not go to the disk unless something changed there:
+	* config.txt is parsed again only if it was modified,
+	* the rom file is read again only if it was modified, otherwise
+	* ram is restored from the pristine image (font + rom) kept from the last load (shared pages, no copy).
+	*/
+	chip8.clear();
+	if (fileChanged("config.txt", configStamp)) loadConfig();
+	//switching to auto mode needs the rom bytes again
+	if (fileChanged(romFilename, romStamp) || !pristineValid || (!chipMode && !detectedMode))
+	{
+		chip8.loadFont();
+		loadProgram();
+		pristineRam = chip8.ram; //shares the pages, the chip copies the ones it writes
+		pristineValid = true;
+	}
+	else chip8.ram = pristineRam;
+	chip8.PC = OFFSET_ROM;
+	chip8.mode = chipMode ? chipMode : detectedMode;
+	chip8.onKeyRead = latencyStats ? observeKeys : NULL;
 }
 
 
-void initDisplay()
+bool fileChanged(const char* filename, FileStamp& stamp)
 {
-	window = SDL_CreateWindow("Chip8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
-	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+	struct stat status;
+	if (filename == NULL || stat(filename, &status))
+	{
+		stamp.modified = stamp.size = -1;
+		return true;
+	}
+	if (stamp.modified == (long long)status.st_mtime && stamp.size == (long long)status.st_size) return false;
+	stamp.modified = (long long)status.st_mtime;
+	stamp.size = (long long)status.st_size;
+	return true;
 }
 
 
-//wave data as a ring data structure provided, loop through wavelength
-WAVE_DATA_TYPE getSineWaveSample()
+void initDisplay()
 {
-	static int wave_current_pos = 0;
-	return wave[wave_current_pos++ % WAVE_LENGTH];
+	window = SDL_CreateWindow("Chip8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, WINDOW_WIDTH, WINDOW_HEIGHT, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 }
 
 
-void audioCallback(void* userdata, Uint8* stream, int len)
+//initialize sdl audio, main thread (SDL wants subsystems initialized there)
+int initAudio()
 {
-	for (int n = 0; n < len; ++n)
+	if (SDL_InitSubSystem(SDL_INIT_AUDIO))
 	{
-		stream[n] = getSineWaveSample();
+		printf("SDL audio failed to initialize : %s\n", SDL_GetError());
+		return -1;
 	}
-	//printf("i need %d bytes for buffer\n", len);
-}
 
-//initialize sdl audio
-int initAudio()
-{
 	/*
 	* Hint Audio:
-	* you need to call SDL_OpenAudioDevice(...)
-	*	no need obtained spec, but if not provided, the desired spec is modified
-	*	allowing changes created problems
-	* how it works (when callback is used)?
-	*	when there is no audio data, SDL calls the audio callback
-	*	that asks for spec.samples * spec.channels data (in bytes) to be filled in stream
-	*	unfilled stream is silenced
-	* Here I used a tone of 480 Hz,
-	* for the 48000 sampling frequency, 48000/480 = 100 samples are needed
-	*	to record one cycle of the sine wave.
-	* To generate the one wave cycle (single channel),
-	*	 maxSpecFormatSize*sin(2*pi*n/N) is used where N is 100 from before.
-	* The audio callback fills the stream with data cycled through this wave cycle data.
-	*	when end is reach, send data from the start.
-	*/
-	SDL_zero(spec);
-	spec.freq = SAMPLING_FREQUENCY;
-	spec.format = AUDIO_S8;
-	spec.channels = 1;
-	spec.samples = 512; //min samples per update
-	spec.callback = audioCallback;
-	spec.userdata = NULL;
-
-	/*
-	* paramter:
-	* NULL	: device default or first available one
-	* 0		: not a recording device
-	* &spec	: desired audio spec we define
-	* NULL	: obtained audio spec the system sets
-	* flags	: allow system to change format as necessary
+	* no callback: the emulation thread queues one timer tick of sound at a time (SDL_QueueAudio),
+	*	synthesized at the rate, format and channel count the device obtained (audio.cpp),
+	*	so SDL has nothing to convert or resample.
+	* flags : device may change rate, format, channels. If the format is one audio.cpp does not write
+	*	(other byte order, unsigned 16 bit), open again without format change and let SDL convert.
+	* Queued sound runs at most AUDIO_QUEUE_TICKS ahead, an empty queue gets a tick of silence first
+	*	(the tick clock and the device clock are not the same, this absorbs the jitter).
 	*/
+	SDL_AudioSpec desired;
+	SDL_zero(desired);
+	desired.freq = SAMPLING_FREQUENCY;
+	desired.format = AUDIO_F32SYS;
+	desired.channels = 1;
+	desired.samples = AUDIO_DEVICE_SAMPLES;
+	desired.callback = NULL;
+
+	dev = SDL_OpenAudioDevice(NULL, 0, &desired, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE | SDL_AUDIO_ALLOW_FORMAT_CHANGE | SDL_AUDIO_ALLOW_CHANNELS_CHANGE);
+	if (dev && (sampleFormat(spec.format) < 0 || spec.channels > 8))
+	{
+		SDL_CloseAudioDevice(dev);
+		dev = SDL_OpenAudioDevice(NULL, 0, &desired, &spec, SDL_AUDIO_ALLOW_FREQUENCY_CHANGE);
+	}
+	if (!dev)
+	{
+		printf("could not open audio device, %s\n", SDL_GetError());
+		return -1;
+	}
 
-	dev = SDL_OpenAudioDevice(NULL, 0, &spec, NULL, 0);
-	if (!dev) printf("could not open audio device, %s\n", SDL_GetError());
-	//else printf("Opened device: %s\n", SDL_GetAudioDeviceName(dev, 0));
+	initMixer(mixer, spec.freq, spec.channels, sampleFormat(spec.format), frequencyTimer);
+	voice.position = 0;
+	voice.level = 0;
+	printf("audio: %d Hz, %d channels, %d bit%s\n", spec.freq, spec.channels, SDL_AUDIO_BITSIZE(spec.format), SDL_AUDIO_ISFLOAT(spec.format) ? " float" : "");
+	SDL_PauseAudioDevice(dev, 0); //plays whatever is queued, silence when nothing is
+	return 0;
+}
 
-	/*
-	* sine wave generation
-	* Asin(2*pi*n/N) where N is the number of samples, n is the position,
-	* A single cycle(wavelength) in N samples.
-	*
-	*/
 
-	for (int n = 0; n < WAVE_LENGTH; ++n)
+int sampleFormat(SDL_AudioFormat format)
+{
+	switch (format)
 	{
-		wave[n] = (WAVE_DATA_TYPE)(sin(2 * M_PI * n / WAVE_LENGTH) * SDL_MAX_SINT8);
+	case AUDIO_U8: return SAMPLE_U8;
+	case AUDIO_S8: return SAMPLE_S8;
+	case AUDIO_S16SYS: return SAMPLE_S16;
+	case AUDIO_S32SYS: return SAMPLE_S32;
+	case AUDIO_F32SYS: return SAMPLE_F32;
+	default: return -1;
 	}
+}
 
-	return 0;
+
+void queueAudio()
+{
+	beginTick(mixer);
+	mixVoice(mixer, voice, chip8);
+	int bytes = endTick(mixer, audioBuffer);
+
+	Uint32 queued = SDL_GetQueuedAudioSize(dev);
+	if (!queued)
+	{
+		//ran dry (or first tick): a tick of silence in front, the next tick has time to arrive
+		static uint8_t silence[sizeof(audioBuffer)];
+		memset(silence, spec.silence, bytes);
+		SDL_QueueAudio(dev, silence, bytes);
+	}
+	if (queued <= (Uint32)bytes * (AUDIO_QUEUE_TICKS - 1)) SDL_QueueAudio(dev, audioBuffer, bytes);
 }
 
 
@@ -349,332 +459,99 @@ void renderToSDLWindow()
 	* *NOTE* needed to render drawing (update screen)
 	* SDL_RenderPresent(renderer);
 	*
-	*
+	* Here the frame is rasterized on the cpu (raster.cpp) straight into a streaming texture,
+	* then copied to the window in one call, instead of one SDL_RenderFillRect per pixel.
 	*/
 
+	Frame& frame = frames[frameFront];
+	uint64_t start = SDL_GetPerformanceCounter();
+
+	//scale can change with a reset (config reload), it comes with the frame
+	if (!texture || textureScale != frame.scale)
+	{
+		if (texture) SDL_DestroyTexture(texture);
+		texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, CHIP8_DISPLAY_WIDTH * frame.scale, CHIP8_DISPLAY_HEIGHT * frame.scale);
+		textureScale = frame.scale;
+	}
+
+	void* pixels;
+	int pitch;
+	if (SDL_LockTexture(texture, NULL, &pixels, &pitch) == 0)
+	{
+		rasterize(frame.rows, (uint32_t*)pixels, pitch / 4, textureScale, frame.filter, PIXEL_ON, PIXEL_OFF);
+		SDL_UnlockTexture(texture);
+	}
+
+	//fit window, keep 2:1
+	int width, height;
+	SDL_GetRendererOutputSize(renderer, &width, &height);
+	SDL_Rect fit = { 0, 0, width, width / 2 };
+	if (fit.h > height) fit = { 0, 0, height * 2, height };
+	fit.x = (width - fit.w) / 2;
+	fit.y = (height - fit.h) / 2;
+
 	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0); //set color
 	SDL_RenderClear(renderer); //draw (need update to see change)
-	SDL_Rect fillRect;
-	for (int y = 0; y < 32; ++y)
-		for (int x = 0; x < 64; ++x)
-		{
-			if (vram[x][y])
-			{
-				SDL_SetRenderDrawColor(renderer, 0xFF, 0xFF, 0xFF, 0xFF); //white
-				fillRect = { x * scaleFactor,y * scaleFactor, scaleFactor, scaleFactor };
-				SDL_RenderFillRect(renderer, &fillRect);
-			}
-		}
+	SDL_RenderCopy(renderer, texture, NULL, &fit);
+	uint64_t drawn = SDL_GetPerformanceCounter();
 	SDL_RenderPresent(renderer);
-}
+	lastPresentTime = SDL_GetPerformanceCounter();
+	lastRenderCost = drawn - start;
 
-uint16_t fetch()
-{
-	//get instruction
-	uint16_t instruction = ram[PC] << 8 | ram[PC + 1]; //join MSB8 and LSB8 to get instruction16, PC incremented by 2
-	PC += 2;
-	//printf("fetched: %04x at %02x\n", instruction, PC - 2);
-	return instruction;
-}
-
-void decodeandexecute(uint16_t instruction)
-{
-	//printf("VX:%2x, VY:%2x , VF:%2x\n", VX, VY, VF);
+	recordLatency(frame, lastPresentTime); //stamps only when LATENCY_STATS is on
 
-	switch (ITYPE)
+	if (startupTime)
 	{
-	case 0x0:
-		switch (instruction)
-		{
-		case 0x00E0:
-			//printf("00E0 display clear");
-			clearDisplay();
-			break;
-		case 0x00EE:
-			//printf("00EE return from subroutine");
-			PC = pop();
-			break;
-		default:
-			//printf("0NNN call");
-			push(PC);
-			PC = NNN;
-			break;
-		}
-		break;
-	case 0x1:
-		//printf("1NNN goto NNN");
-		PC = NNN;
-		break;
-	case 0x2:
-		//printf("2NNN call subrouting at NNN");
-		push(PC);
-		PC = NNN;
-		break;
-	case 0x3:
-		//printf("3XNN if VX==NN skip next instruction");
-		if (VX == (NN)) PC += 2;
-		break;
-	case 0x4:
-		//printf("4XNN if VX!=NN skip next instruction");
-		if (VX != (NN)) PC += 2;
-		break;
-	case 0x5:
-		//printf("5XY0 if VX==VY skip next instruction");
-		if (VX == VY) PC += 2;
-		break;
-	case 0x6:
-		//printf("6XNN set VX=NN");
-		VX = NN;
-		break;
-	case 0x7:
-		//printf("7XNN set VX=VX+NN, VF not changed");
-		VX += NN;
-		break;
-	case 0x8:
-		switch (instruction & 0x000F)
-		{
-		case 0x0:
-			//printf("8XY0 VX = VY");
-			VX = VY;
-			break;
-		case 0x1:
-			//printf("8XY1 VX = VY | VY (or)");
-			VX |= VY;
-			if (mode & COSMACVIP) VF = 0;
-			break;
-		case 0x2:
-			//printf("8XY2 VX = VY & VY (and)");
-			VX &= VY;
-			if (mode & COSMACVIP) VF = 0;
-			break;
-		case 0x3:
-			//printf("8XY3 VX ^= VY (xor)");
-			VX ^= VY;
-			if (mode & COSMACVIP) VF = 0;
-			break;
-		case 0x4:
-		{
-			//printf("8XY4 VX = VX + VY (add), VF carry flag");
-			uint16_t carrysum = (uint16_t)VX + (uint16_t)VY;
-			VX = carrysum & 0x00FF;
-			VF = uint8_t(carrysum >> 8) & 0x01;
-			break;
-		}
-		case 0x5:
-		{
-			//printf("8XY5 VX = VX - VY (sub), VF burrow flag, 0 when burrow");
-			int borrowdiff = ((uint16_t)VX | 0x0100) - (uint16_t)VY;
-			VX = borrowdiff & 0x00FF;
-			VF = (borrowdiff >> 8) & 0x01;
-			break;
-		}
-		case 0x6:
-			//printf("start %02x %02x %02x should be %02x %02x %02x\n", VX, VY, VF, VX >> 1, VY >> 1, VF >> 1);
-			if (mode & COSMACVIP) //use VY
-			{
-				//printf("8XY6 VX = VY >> 1 (shiftr1), shift out to VF");
-				uint8_t tmp = VY;
-				VX = tmp >> 1;
-				VF = tmp & 0x01;
-			}
-			if (mode & (CHIP48 | SUPERCHIP))
-			{
-				//ignore VY
-				uint8_t tmp = VX;
-				VX = tmp >> 1;
-				VF = tmp & 0x01;
-			}
-			//printf("end %02x %02x %02x\n", VX, VY, VF); //std::cin.get();
-			break;
-		case 0x7:
-		{
-			//printf("8XY7 VX = VY - VX (sub reverse), VF burrow flag, 0 when burrow");
-			uint16_t borrowdiff = ((uint16_t)VY | 0x0100) - (uint16_t)VX;
-			VX = borrowdiff & 0x00FF;
-			VF = (borrowdiff >> 8) & 0x01;
-			break;
-		}
-		case 0xE:
-			if (mode & COSMACVIP) //use VY
-			{
-				//printf("8XYE VX = VX << 1 (shiftl1), shift out to VF");
-				uint8_t tmp = VY;
-				VX = tmp << 1;
-				VF = tmp >> 7;
-			}
-			if (mode & (CHIP48 | SUPERCHIP))
-			{
-				//ignore VY
-				uint8_t tmp = VX;
-				VX = tmp << 1;
-				VF = tmp >> 7;
-			}
-			break;
-		default:
-			break;
-		}
-		break;
-	case 0x9:
-		//printf("9XY0 if VX != VY, skip next instruction");
-		if (VX != VY) PC += 2;
-		break;
-	case 0xA:
-		//printf("ANNN set I to NNN");
-		I = NNN;
-		break;
-	case 0xB:
-		//printf("BNNN jump to address (V0+NNN)");
-		if (mode & SUPERCHIP) PC = NNN + VX;
-		if (mode & COSMACVIP) PC = NNN + V0;
-
-
-		break;
-	case 0xC:
-		//printf("CXNN set VX = rand0 & NN");
-		VX = uint8_t(rand() % 0xFF) & NN;
-		break;
-	case 0xD:
-		//printf("DXYN draw sprite at (VX,VY), width 8 and height N");
-		draw(VX, VY, N) ? VF = 0x01 : VF = 0x0;
-		break;
-	case 0xE:
-		switch (instruction & 0x00FF)
-		{
-		case 0x9E:
-			//printf("EX9E skip next instruction if key stored in VX pressed");
-			//printf("Instruction : %4x, %x key pressed? : %d, %x  \n", instruction, VX, keyIsPressed, pressedKeyHex);
-			if (keyIsPressed && pressedKeyHex == VX)
-			{
-				PC += 2;
-				//printf("ex9e key pressed. skipping next\n");
-			}
-			break;
-		case 0xA1:
-			//printf("EXA1 skip next instruction if key stored in VX NOT pressed");
-			//printf("Instruction : %4x, %x key not pressed? : %d, %x  \n", instruction, VX, keyIsPressed, pressedKeyHex);
-			if (!keyIsPressed || pressedKeyHex != VX)
-			{
-				PC += 2;
-				//printf("exA1 key not pressed. skipping next\n");
-			}
-			break;
-		default:
-			break;
-		}
-		break;
-	case 0xF:
-		switch (instruction & 0x00FF)
-		{
-		case 0x07:
-			//printf("FX07 set VX to value of delay timer");
-			VX = timerDelay;
-			break;
-		case 0x0A:
-			//printf("FX0A wait keypress, store in VX (blocking) ");
-			/*
-			* state machine:
-			* //infinite loop until state machine complete
-			* 00 : wait press,
-			* |
-			* |keyIsPressed
-			* |
-			* V
-			* 01 : wait release / not wait press
-			* |
-			* |!keyIsPressed ===> store in VX, escape loop
-			* |
-			* V
-			* 00
-			*/
-			//default state machine output : infinite loop
-			PC -= 2;
-			if (waitingKeyPress) //state 00
-			{
-				if (keyIsPressed) waitingKeyPress = false; //change state to 01
-			}
-			else //state 01 
-			{ //not waiting key press / waiting key release
-				if (!keyIsPressed) //key released
-				{
-					VX = pressedKeyHex; //store
-					PC += 2; //break from infinite loop ,escape
-					waitingKeyPress = true; // restore state machine , change back to 00
-				}
-			}
-			break;
-		case 0x15:
-			//printf("FX15 set timerDelay = VX");
-			timerDelay = VX;
-			break;
-		case 0x18:
-			//printf("FX18 set timerSound = %d\n", VX);
-			timerSound = VX;
-			break;
-		case 0x1E:
-			//printf("FX1E I = I + VX , VF unchanged");
-			I += VX;
-			break;
-		case 0x29:
-			//printf("FX29 I = font[VX], set I to font sprite address stored in VX");
-			I = font(VX);
-			break;
-		case 0x33:
-			//printf("FX33 store BCD : 123 => I=1, I+1=2, I+2=3");
-		{
-			int value = VX;
-			for (int i = 2; i >= 0;--i) //2 1 0
-			{
-				ram[I + i] = value % 10;
-				value = value / 10;
-			}
-		}
-		break;
-		case 0x55:
-			for (int i = 0; i <= X; ++i)
-			{
-				//printf("FX55 store V0 to VX in memory from address I as offset (no change I)");
-				if (mode & COSMACVIP) ram[I++] = V[i];
-				//printf("FX55 store V0 to VX in memory from address I as offset (increment I)");
-				if (mode & (CHIP48 | SUPERCHIP)) ram[I + i] = V[i];
-			}
-			break;
-		case 0x65:
-			//printf("FX65 load V0 to VX from memory from address I as offset (no change in I)");
-			for (int i = 0; i <= X; ++i)
-			{
-				//printf("FX65 fill V0 to VX from memory from address I as offset (no change I)");
-				if (mode & COSMACVIP) V[i] = ram[I++];
-				//printf("FX65 fill V0 to VX from memory from address I as offset (increment I)");
-				if (mode & (CHIP48 | SUPERCHIP)) V[i] = ram[I + i];
-			}
-			break;
-		default:
-			break;
-		}
-	default:
-		break;
+		printf("startup to first frame: %.2f ms\n", (lastPresentTime - startupTime) * 1000.0 / SDL_GetPerformanceFrequency());
+		startupTime = 0;
 	}
-	//printf("VX:%2x, VY:%2x , VF:%2x\n", VX, VY, VF);
+}
+
+template <bool DEBUG>
+void cycle()
+{
+	if (DEBUG && !debugBeforeExecute()) return; //paused or breakpoint
+	chip8.step<DEBUG>();
+	if (DEBUG) debugAfterExecute();
 }
 
 
+template <bool DEBUG>
 void emulate()
 {
 	//timers
 
+	/*
+	* Tick n is due n/frequencyTimer s after timerStart, the rate holds over time whatever the
+	* ms rounding (the mixer makes rate/frequencyTimer samples per tick, fewer ticks starve the device).
+	* More than TIMER_RESYNC_MS late (debugger pause, stall): start over from now, no burst of ticks.
+	*/
 	uint32_t currentMS = SDL_GetTicks();
-	if ((currentMS - lastTimerUpdate) > FREQUENCY_TO_MILLIS(frequencyTimer))
+	uint32_t timerDue = frequencyTimer > 0 ? timerStart + (uint32_t)(timerTicks * 1000 / frequencyTimer) : currentMS + 1;
+	if ((int32_t)(currentMS - timerDue) >= 0)
 	{
-		lastTimerUpdate = currentMS;
-		if (timerDelay)timerDelay--;
-		if (timerSound)	SDL_PauseAudioDevice(dev, --timerSound ? 0 : 1);	//if timerSound register non zero, decrement and play if new value non zero. SoundTimer set to 1 at execution has no effect.
+		if (currentMS - timerDue > TIMER_RESYNC_MS)
+		{
+			timerStart = currentMS;
+			timerTicks = 0;
+		}
+		timerTicks++;
+		chip8.timerTick();
+		//sound while the decremented value is non zero (SoundTimer set to 1 at execution has no effect),
+		//the first time the device is asked for, once open every tick is queued, silence too: the device clock never waits for a beep
+		if (requestAudio(audioState, chip8)) queueAudio();
 	}
 
-	//display
+	//display, hand the frame to the render thread, presenting (vsync) never blocks emulation
 	if ((currentMS - lastFrameUpdate) > FREQUENCY_TO_MILLIS(frameRate))
 	{
 		lastFrameUpdate = currentMS;
-		renderToSDLWindow();
+		applyKeys(); //input changes only here, at frame boundaries
+		aheadCycles = frameCycles; //what the real chip ran this frame, the copy runs as fast
+		frameCycles = 0;
+		if (runAhead > 0 && !DEBUG) publishAhead(); //debugger shows the real machine
+		else if (chip8.vramVersion != publishedVersion) publishFrame(chip8);
+		if (DEBUG) debugFrameEnd();
 	}
 
 	//run CPU cycle
@@ -683,12 +560,15 @@ void emulate()
 		if ((currentMS - lastCPUExecute) > FREQUENCY_TO_MILLIS(frequencyCPU))
 		{
 			lastCPUExecute = currentMS;
-			decodeandexecute(fetch());
+			cycle<DEBUG>();
+			frameCycles++;
 		}
 	}
 	else
 	{
-		decodeandexecute(fetch());
+		//no limit: a slice of instructions per timing check
+		for (int i = 0; i < UNLIMITED_SLICE; ++i) cycle<DEBUG>();
+		frameCycles += UNLIMITED_SLICE;
 	}
 	//render();
 }
@@ -706,65 +586,52 @@ void emulate()
  * Scancode based, same key position even if different layout
 */
 
+int keypadKey(SDL_Scancode scancode)
+{
+	switch (scancode)
+	{
+	case SDL_SCANCODE_1: return 0x1;
+	case SDL_SCANCODE_2: return 0x2;
+	case SDL_SCANCODE_3: return 0x3;
+	case SDL_SCANCODE_4: return 0xC;
+	case SDL_SCANCODE_Q: return 0x4;
+	case SDL_SCANCODE_W: return 0x5;
+	case SDL_SCANCODE_E: return 0x6;
+	case SDL_SCANCODE_R: return 0xD;
+	case SDL_SCANCODE_A: return 0x7;
+	case SDL_SCANCODE_S: return 0x8;
+	case SDL_SCANCODE_D: return 0x9;
+	case SDL_SCANCODE_F: return 0xE;
+	case SDL_SCANCODE_Z: return 0xA;
+	case SDL_SCANCODE_X: return 0x0;
+	case SDL_SCANCODE_C: return 0xB;
+	case SDL_SCANCODE_V: return 0xF;
+	default: return -1;
+	}
+}
+
+
 void handleKeyDown()
 {
-	keyIsPressed = true;
-	switch (e.key.keysym.scancode)
+	int key = keypadKey(e.key.keysym.scancode);
+	if (key >= 0)
+	{
+		if (!e.key.repeat) queueKey((uint8_t)key, true);
+		return;
+	}
 
+	switch (e.key.keysym.scancode)
 	{
-	case SDL_SCANCODE_1:
-		pressedKeyHex = 0x1;
-		break;
-	case SDL_SCANCODE_2:
-		pressedKeyHex = 0x2;
-		break;
-	case SDL_SCANCODE_3:
-		pressedKeyHex = 0x3;
-		break;
-	case SDL_SCANCODE_4:
-		pressedKeyHex = 0xC;
-		break;
-	case SDL_SCANCODE_Q:
-		pressedKeyHex = 0x4;
-		break;
-	case SDL_SCANCODE_W:
-		pressedKeyHex = 0x5;
-		break;
-	case SDL_SCANCODE_E:
-		pressedKeyHex = 0x6;
-		break;
-	case SDL_SCANCODE_R:
-		pressedKeyHex = 0xD;
-		break;
-	case SDL_SCANCODE_A:
-		pressedKeyHex = 0x7;
-		break;
-	case SDL_SCANCODE_S:
-		pressedKeyHex = 0x8;
-		break;
-	case SDL_SCANCODE_D:
-		pressedKeyHex = 0x9;
-		break;
-	case SDL_SCANCODE_F:
-		pressedKeyHex = 0xE;
-		break;
-	case SDL_SCANCODE_Z:
-		pressedKeyHex = 0xA;
-		break;
-	case SDL_SCANCODE_X:
-		pressedKeyHex = 0x0;
-		break;
-	case SDL_SCANCODE_C:
-		pressedKeyHex = 0xB;
-		break;
-	case SDL_SCANCODE_V:
-		pressedKeyHex = 0xF;
-		break;
 	case SDL_SCANCODE_ESCAPE:
+		traceOnQuit = true;
 		quit = true;
 		break;
 	case SDL_SCANCODE_BACKSPACE:
-		init();
+		resetRequestTime = SDL_GetPerformanceCounter();
+		resetRequested = true; //emulation thread owns the chip, let it reset
+		break;
+	case SDL_SCANCODE_F12:
+		captureFrame(frames[frameFront]); //render thread owns the front frame
 		break;
 	default:
 		break;
@@ -772,12 +639,136 @@ void handleKeyDown()
 }
 
 
+void handleKeyUp()
+{
+	int key = keypadKey(e.key.keysym.scancode);
+	if (key >= 0) queueKey((uint8_t)key, false);
+}
+
+
+/*
+* Key events, render thread => emulation thread (single producer, single consumer ring).
+* The emulation thread applies them all at the next frame boundary, so the instructions
+* between two boundaries always see the same keypad, and a run does not depend on where in
+* the instruction stream an event happened to arrive. A key pressed and released within
+* one frame stays down for that frame (released at the next boundary), it is never lost.
+*/
+void queueKey(uint8_t key, bool down)
+{
+	//keypad state after this event first, the emulation thread falls back on it if the queue overflows
+	uint16_t keys = keysLatest.load(memory_order_relaxed);
+	keysLatest.store(down ? keys | (1 << key) : keys & ~(1 << key), memory_order_release);
+
+	uint32_t head = keyQueueHead.load(memory_order_relaxed);
+	if (head - keyQueueTail.load(memory_order_acquire) >= KEY_QUEUE_SIZE)
+	{
+		keyQueueOverflow.store(true, memory_order_release); //full, emulation thread stalled: no event lost, keysLatest has it
+		return;
+	}
+	KeyEvent& event = keyQueue[head % KEY_QUEUE_SIZE];
+	event.key = key;
+	event.down = down;
+	event.time = SDL_GetPerformanceCounter();
+	keyQueueHead.store(head + 1, memory_order_release);
+}
+
+
+void applyKeys()
+{
+	chip8.keys &= ~keysReleasing;
+	keysReleasing = 0;
+
+	uint16_t pressed = 0;
+	uint32_t tail = keyQueueTail.load(memory_order_relaxed), head = keyQueueHead.load(memory_order_acquire);
+	for (; tail != head; ++tail)
+	{
+		const KeyEvent& event = keyQueue[tail % KEY_QUEUE_SIZE];
+		uint16_t bit = 1 << event.key;
+		if (event.down)
+		{
+			chip8.keys |= bit;
+			pressed |= bit;
+			keysReleasing &= ~bit;
+		}
+		else if (pressed & bit) keysReleasing |= bit; //pressed in this batch, up at the next one
+		else chip8.keys &= ~bit;
+		if (!keyEventTime) keyEventTime = event.time; //oldest event no instruction has seen yet
+	}
+
+	/*
+	* Overflow: events were not queued, order is lost (a dropped release would leave a key down).
+	* Everything queued up to now is dropped and the keypad becomes the state after the last event,
+	* events queued after that head are newer than the state read and still apply in order.
+	*/
+	if (keyQueueOverflow.exchange(false, memory_order_acq_rel))
+	{
+		tail = keyQueueHead.load(memory_order_acquire);
+		chip8.keys = keysLatest.load(memory_order_acquire);
+		keysReleasing = 0;
+	}
+	keyQueueTail.store(tail, memory_order_release);
+}
+
+
+template <bool DEBUG>
+void runEngine()
+{
+	//leaves when the debugger wants the other engine
+	while (!quit && !resetRequested && debugEngine == DEBUG) emulate<DEBUG>();
+}
+
+
+void runEmulation()
+{
+	//loop unless quit event, only this thread touches chip components
+	while (!quit)
+	{
+		if (resetRequested)
+		{
+			resetRequested = false;
+			init();
+			printf("reset: %.3f ms\n", (SDL_GetPerformanceCounter() - resetRequestTime) * 1000.0 / SDL_GetPerformanceFrequency());
+		}
+		if (debugEngine) runEngine<true>();
+		else runEngine<false>();
+	}
+}
+
+
 void run()
 {
+	/*
+	* Threads:
+	* emulation thread : cpu, timers, queues sound, publishes finished frames
+	* render thread (this one, SDL wants events and rendering on the main thread) :
+	*	polls events, writes key state, presents the newest published frame.
+	* A vsync blocked SDL_RenderPresent only stalls this thread.
+	* Audio is opened here too, only once the emulation thread saw the sound timer run (audioState),
+	* roms that never beep never open a device. That thread only queues sound, after AUDIO_OPEN.
+	*/
+	for (int f = 0; f < FRAME_BUFFERS; ++f) setFrameConfig(frames[f]); //config loaded, no frame published yet
+	thread emulation(runEmulation);
+
+	/*
+	* Present modes:
+	* 0 : present as soon as a new frame arrives, vsync blocks until the next vblank.
+	*	  A frame (and the input it shows) can wait almost a whole refresh interval.
+	* 1 : just in time, sleep until shortly before the expected vblank,
+	*	  then poll input, take the newest frame, draw and present.
+	*	  Expected vblank comes from the last present return plus the refresh interval,
+	*	  wake up margin is the last draw cost plus PRESENT_MARGIN_US.
+	*/
+	uint64_t frequency = SDL_GetPerformanceFrequency();
+	uint64_t refresh = frequency / displayRefreshRate();
+	uint64_t margin = frequency * PRESENT_MARGIN_US / 1000000;
+	uint64_t nextVblank = SDL_GetPerformanceCounter();
+
+	bool redraw = true;
 	//loop unless quit event (Window closed or quit key press)
 	while (!quit)
 	{
-		emulate();
+		if (audioState.load(memory_order_acquire) == AUDIO_WANTED) audioState.store(initAudio() ? AUDIO_FAILED : AUDIO_OPEN, memory_order_release);
+		if (frames[frameFront].presentMode == 1) waitUntil(nextVblank - lastRenderCost - margin);
 
 		//Handle events on queue
 		while (SDL_PollEvent(&e) != 0)
@@ -794,72 +785,220 @@ void run()
 			}
 			else if (e.type == SDL_KEYUP)
 			{
-				keyIsPressed = false;
+				handleKeyUp();
+			}
+			else if (e.type == SDL_WINDOWEVENT)
+			{
+				redraw = true; //resized or exposed, show the current frame again
 			}
 		}
-	}
-}
 
+		if (acquireFrame()) redraw = true;
 
+		if (frames[frameFront].presentMode == 1)
+		{
+			if (redraw) renderToSDLWindow();
+			//after a present the vblank is known again, otherwise assume it passed
+			nextVblank = redraw ? lastPresentTime + refresh : nextVblank + refresh;
+			uint64_t now = SDL_GetPerformanceCounter();
+			while (nextVblank < now + margin) nextVblank += refresh;
+			redraw = false;
+		}
+		else if (redraw)
+		{
+			renderToSDLWindow();
+			redraw = false;
+		}
+		else SDL_Delay(1); //nothing new to show
+	}
 
+	emulation.join();
+}
 
 
-void push(uint16_t address)
+/*
+* Triple buffer:
+* three frames, each owned by exactly one side at any time.
+* frameBack  : emulation thread writes vram here
+* frameReady : last complete frame, swapped atomically by both sides
+* frameFront : render thread reads it while presenting
+* Publishing swaps back <=> ready (marked fresh), acquiring swaps front <=> ready (if fresh).
+* Neither side waits, the render thread always gets the newest complete frame.
+*/
+void publishFrame(const Chip8& chip)
 {
-	if (stackPointer < 255)
+	Frame& frame = frames[frameBack];
+	chip.packRows(frame.rows);
+	setFrameConfig(frame);
+	publishedVersion = chip.vramVersion;
+
+	//latency stamps: a skipped frame never reached the screen, its change goes out with this one
+	bool carry = frameSkipped && frame.keyEventTime;
+	if (!carry) frame.keyEventTime = frame.keyObserveTime = 0;
+	if (latencyArmed && chip.vramVersion != latencyVersion)
 	{
-		stack[++stackPointer] = address;
+		if (!carry)
+		{
+			frame.keyEventTime = latencyEventTime;
+			frame.keyObserveTime = latencyObserveTime;
+		}
+		latencyArmed = false;
 	}
+
+	uint8_t previous = frameReady.exchange(frameBack | FRAME_FRESH, memory_order_acq_rel);
+	frameBack = previous & FRAME_INDEX;
+	frameSkipped = previous & FRAME_FRESH;
 }
 
-uint16_t pop()
+
+/*
+* Run ahead (as in RetroArch):
+* the real chip advances one frame at a time as usual, at every frame tick a copy of it
+* (ram pages shared, registers/stack/vram/timers copied) runs runAhead more frames
+* with the keys as they are now and that screen is shown. The copy is thrown away,
+* so a game reacting to a key k frames late is seen reacting up to runAhead frames earlier.
+* Each frame ahead runs as many instructions as the real chip ran in its last frame
+* (one per tick limited, UNLIMITED_SLICE per emulate() call unlimited).
+* The copy does not trace, touch audio or stamp latency (only the real chip sees keys).
+* It runs every frame: the screen ahead also depends on timers, the random state, PC and FX0A,
+* a screen that does not change now can still change in the frames ahead.
+* Cost: runAhead frames of emulation per shown frame, see benchmark.cpp.
+*/
+void publishAhead()
+{
+	aheadChip = chip8;
+	aheadChip.trace = NULL;
+	aheadChip.onKeyRead = NULL;
+	for (int f = 0; f < runAhead; ++f) aheadChip.runFrame(aheadCycles);
+	publishFrame(aheadChip); //a copy's vramVersion says nothing about the last one shown, always publish
+}
+
+
+void setFrameConfig(Frame& frame)
+{
+	frame.scale = scaleFactor > 0 ? scaleFactor : 1;
+	frame.filter = scaleFilter;
+	frame.presentMode = presentMode;
+}
+
+
+bool acquireFrame()
+{
+	if (!(frameReady.load(memory_order_relaxed) & FRAME_FRESH)) return false;
+
+	frameFront = frameReady.exchange(frameFront, memory_order_acq_rel) & FRAME_INDEX;
+	return true;
+}
+
+
+void captureFrame(const Frame& frame)
+{
+	static int captures = 0;
+	int width = CHIP8_DISPLAY_WIDTH * frame.scale, height = CHIP8_DISPLAY_HEIGHT * frame.scale;
+	uint32_t* pixels = new uint32_t[width * height];
+	rasterize(frame.rows, pixels, width, frame.scale, frame.filter, PIXEL_ON, PIXEL_OFF);
+
+	char filename[64];
+	snprintf(filename, sizeof(filename), CAPTURE_FILE, captures++);
+	if (writePPM(filename, pixels, width, height, width)) printf("saved %s\n", filename);
+	delete[] pixels;
+}
+
+
+void waitUntil(uint64_t time)
 {
-	if (stackPointer >= 0)
+	uint64_t frequency = SDL_GetPerformanceFrequency();
+	for (uint64_t now = SDL_GetPerformanceCounter(); now < time; now = SDL_GetPerformanceCounter())
 	{
-		return stack[stackPointer--];
+		uint64_t ms = (time - now) * 1000 / frequency;
+		if (ms > 1) SDL_Delay((uint32_t)ms - 1); //SDL_Delay oversleeps, spin the rest
 	}
-	return -1;
 }
 
 
-
-void clearDisplay()
+int displayRefreshRate()
 {
-	for (int i = 0; i < 64; ++i)
-		for (int j = 0; j < 32; ++j)
-			vram[i][j] = 0;
+	SDL_DisplayMode displayMode;
+	if (SDL_GetCurrentDisplayMode(SDL_GetWindowDisplayIndex(window), &displayMode) || displayMode.refresh_rate <= 0) return 60;
+	return displayMode.refresh_rate;
 }
 
 
-bool setPixel(uint8_t x, uint8_t y, bool bit)
+/*
+* Key to photon latency:
+* render thread : stamps each queued key event (SDL event timestamps are only ms)
+* emulation thread : applyKeys() keeps the oldest stamp not seen yet in keyEventTime
+* emulation thread : first EX9E/EXA1/FX0A afterwards takes the stamp and stamps itself,
+*	the next vram change carries both stamps into the published frame
+* render thread : after presenting that frame, adds the three intervals to the histograms
+* Present return is used as photon time, display scanout/response is not included.
+*/
+void observeKeys(Chip8& chip)
 {
-	vram[x][y] ^= bit; //xor with new bit
-	return !vram[x][y] && bit; //return if flipped or not
+	if (!keyEventTime) return; //nothing new
+	latencyEventTime = keyEventTime;
+	keyEventTime = 0;
+	latencyObserveTime = SDL_GetPerformanceCounter();
+	latencyArmed = true;
+	latencyVersion = chip.vramVersion; //stamps go with the first frame after a clear/draw
 }
 
 
-bool draw(uint8_t x, uint8_t y, uint8_t num)
+void recordLatency(Frame& frame, uint64_t presentTime)
 {
-	//wrap around start coordinate
-	x = x % CHIP8_DISPLAY_WIDTH;
-	y = y % CHIP8_DISPLAY_HEIGHT;
+	if (!frame.keyEventTime) return;
+
+	uint64_t frequency = SDL_GetPerformanceFrequency();
+	uint64_t interval[3];
+	interval[LATENCY_OBSERVE] = frame.keyObserveTime - frame.keyEventTime;
+	interval[LATENCY_DISPLAY] = presentTime - frame.keyObserveTime;
+	interval[LATENCY_TOTAL] = presentTime - frame.keyEventTime;
+	for (int h = 0; h < 3; ++h)
+	{
+		uint64_t us = interval[h] * 1000000 / frequency;
+		uint64_t bucket = us / 1000;
+		latencyHistogram[h][bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+		latencySum[h] += us;
+	}
 
-	bool setToUnset = false; //set flag 0
+	frame.keyEventTime = 0; //count once, frame may be presented again (resize)
+}
 
-	//get 8 bit pixels data, 
-	//set at y pixel x to x+7 (increment x 1 at a time)
-	//increment y upto y+N-1, get next 8 bit pixel data
-	uint8_t pixel8 = 0;
-	for (int n = 0; n < num && (y + n) < CHIP8_DISPLAY_HEIGHT; ++n) //clip if boundary exceeded
+
+void reportLatency()
+{
+	const char* names[3] = { "key event => instruction", "instruction => present", "key event => present (key to photon)" };
+	for (int h = 0; h < 3; ++h)
 	{
-		pixel8 = ram[I + n];
-		for (int p = 0; p < 8 && (x + p) < CHIP8_DISPLAY_WIDTH; ++p)//clip if boundary exceeded
+		uint64_t count = 0, most = 0;
+		for (int b = 0; b < LATENCY_BUCKETS; ++b)
+		{
+			count += latencyHistogram[h][b];
+			if (latencyHistogram[h][b] > most) most = latencyHistogram[h][b];
+		}
+		printf("\n%s : %llu samples", names[h], (unsigned long long)count);
+		if (!count) { printf("\n"); continue; }
+
+		//median and 99th percentile as bucket upper bounds
+		uint64_t seen = 0;
+		int p50 = -1, p99 = -1;
+		for (int b = 0; b < LATENCY_BUCKETS; ++b)
+		{
+			seen += latencyHistogram[h][b];
+			if (p50 < 0 && seen * 2 >= count) p50 = b + 1;
+			if (p99 < 0 && seen * 100 >= count * 99) p99 = b + 1;
+		}
+		printf(", mean %.2f ms, p50 <%d ms, p99 <%d ms\n", latencySum[h] / 1000.0 / count, p50, p99);
+
+		for (int b = 0; b < LATENCY_BUCKETS; ++b)
 		{
-			//if (setPixel(x + p, y + n, (pixel8 >> (7 - p)) & 0x1)) setToUnset = true;
-			setToUnset |= setPixel(x + p, y + n, (pixel8 >> (7 - p)) & 0x1);
+			if (!latencyHistogram[h][b]) continue;
+			int bar = (int)(latencyHistogram[h][b] * 50 / most);
+			printf(b < LATENCY_BUCKETS - 1 ? "%3d ms |" : "%2d+ ms |", b);
+			for (int i = 0; i < bar; ++i) printf("#");
+			printf(" %llu\n", (unsigned long long)latencyHistogram[h][b]);
 		}
 	}
-	return setToUnset;
 }
 
 
@@ -872,7 +1011,7 @@ void renderToConsole()
 		printf("%02d|", y);
 		for (uint8_t x = 0; x < 64; ++x)
 		{
-			vram[x][y] ? printf("**") : printf("  ");
+			chip8.vram[x][y] ? printf("**") : printf("  ");
 		}
 		printf("|");
 		printf("\n");
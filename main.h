@@ -2,152 +2,214 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <cstdint>
+#include <atomic>
+#include <thread>
 
 #include "SDL.h"
+#include "raster.h"
+#include "chip8.h"
+#include "audio.h"
 
 using namespace std;
 
 /*MACRO definitions**************************************************************************************************************************/
 
-/*chip modes*/
-#define COSMACVIP	0x1
-#define CHIP48		0x2
-#define SUPERCHIP	0x4
-#define CHIPMODE  COSMACVIP //default chip mode
-
-/*Registers*/
-#define V0		V[0x0]
-#define V1 		V[0x1]
-#define V2 		V[0x2]
-#define V3 		V[0x3]
-#define V4 		V[0x4]
-#define V5 		V[0x5]
-#define V6 		V[0x6]
-#define V7 		V[0x7]
-#define V8 		V[0x8]
-#define V9 		V[0x9]
-#define VA		V[0xA]
-#define VB		V[0xB]
-#define VC		V[0xC]
-#define VD		V[0xD]
-#define VE		V[0xE]
-#define VF		V[0xF]
-
-/*instruction extractions*/
-#define ITYPE	(instruction>>12)				//instruction type(Most significant Byte)
-#define X		((instruction & 0x0F00) >> 8)	//X Register name
-#define VX		V[X]							//X Register
-#define VY		V[(instruction & 0x00F0) >> 4]	//Y Register
-#define N		(instruction & 0x000F)			//Immediate
-#define NN		(instruction & 0x00FF)			//Immediate
-#define NNN		(instruction & 0x0FFF)			//Address
-
-/*font address translation*/
-#define OFFSET_FONT			0x0050				//Address where font data begins
-#define BYTES_PER_FONT		5					//Each font sprite needs 5 byte
-#define font(x)				(OFFSET_FONT + ((x & 0x000F)*BYTES_PER_FONT)) //Get font x address
-
-/*load ROM*/
-#define OFFSET_ROM			0x0200	// Address where ROM data begins
-
 /*SDL rendering*/
 #define SCALE_FACTOR			10	//scale factor for 64x32 pixels (Square pixel length)
-#define CHIP8_DISPLAY_WIDTH		64	//Chip8 screen width
-#define CHIP8_DISPLAY_HEIGHT	32	//Chip8 screen height
 #define WINDOW_WIDTH			(CHIP8_DISPLAY_WIDTH*scaleFactor)	//Display window width
 #define WINDOW_HEIGHT			(CHIP8_DISPLAY_HEIGHT*scaleFactor)	//Display window height
+#define SCALE_FILTER			FILTER_NONE	//smoothing, see raster.h
+#define CAPTURE_FILE			"capture_%03d.ppm"	//F12 screenshot
+
+/*SDL audio, synthesis in audio.h, rate/format/channels are what the device gives*/
+#define SAMPLING_FREQUENCY		48000		//asked for, the device may pick another rate
+#define AUDIO_DEVICE_SAMPLES	512			//device buffer
+#define AUDIO_QUEUE_TICKS		3			//timer ticks of sound queued ahead at most, more is dropped (device slower than the timer)
+
 
-/*SDL audio, handle audio (sine wave)*/
-#define SINE_FREQUENCY			480			//tone frequency
-#define SAMPLING_FREQUENCY		48000		//wave data samples per seconds
-#define N_SAMPLES				(SAMPLING_FREQUENCY / SINE_FREQUENCY) //data samples per cycle
-#define WAVE_DATA_TYPE			Sint8		//wave data sample size (8 bit here for mono channel single byte data)
-#define WAVE_LENGTH			 (N_SAMPLES)	// #values for a single wavelength of wave
+/*key events, render thread => emulation thread*/
+#define KEY_QUEUE_SIZE	256		//events, power of 2
+
+/*frame handoff, emulation thread => render thread (lock-free triple buffer)*/
+#define FRAME_BUFFERS	3		//one being written, one ready, one on screen
+#define FRAME_INDEX		0x03	//buffer index bits of frameReady
+#define FRAME_FRESH		0x04	//frameReady holds a frame not shown yet
 
 
 /*handle timing*/
 #define ENABLE_DELAY 1			//enable/disable CPU frequency limit, 0 if no limit
 #define FREQUENCY_TO_MILLIS(x) (1000.0/x)	//convert frequency to milliseconds
 #define FREQUENCY_TIMER 60 //Hz	//timers #(down)counts per seconds
+#define TIMER_RESYNC_MS	100		//timer ticks this late start over instead of catching up
 #define FRAME_RATE 60//Hz		//frames per seconds
+#define RUN_AHEAD 0				//frames emulated ahead on a copy of the chip and shown instead (hides game input lag), 0 off
 #define FREQUENCY_CPU 700//Hz	//CPU frequency limit
+#define UNLIMITED_SLICE	1000	//no frequency limit: instructions between timing checks
+
+/*present timing*/
+#define PRESENT_MODE		0		//0 present as soon as a frame is ready, 1 just in time before vblank
+#define PRESENT_MARGIN_US	2000	//just in time: wake this much before the expected vblank (plus measured render time)
+
+/*input latency measurement*/
+#define LATENCY_STATS		0		//timestamp key event => instruction reading it => present, report on exit
+#define LATENCY_BUCKETS		64		//1 ms histogram buckets, last bucket collects everything slower
+#define LATENCY_OBSERVE		0		//histogram: key event => first EX9E/EXA1/FX0A that sees it
+#define LATENCY_DISPLAY		1		//histogram: that instruction => present of the first changed frame
+#define LATENCY_TOTAL		2		//histogram: key event => present (key to photon)
 
 /**Type Definitions********************************************************************************************************************/
-typedef uint8_t Reg8;	//8 bit reg
-typedef uint16_t Reg16; //16 bit reg
+typedef struct FileStamp
+{
+	long long modified;		//mtime
+	long long size;
+} FileStamp;
+
+typedef struct KeyEvent
+{
+	uint8_t key;		//0x0-0xF
+	bool down;
+	uint64_t time;		//performance counter when queued
+} KeyEvent;
+
+typedef struct Frame
+{
+	uint64_t rows[32];		//vram published by the emulation thread, packed rows (bit 63 is x=0)
+	uint64_t keyEventTime;		//latency stamps of the key event this frame answers, 0 if none
+	uint64_t keyObserveTime;
+
+	/*config it was published with, a reset reloads config.txt on the emulation thread, the render thread reads only these*/
+	int scale;
+	int filter;
+	int presentMode;
+} Frame;
 
 /**Global Variables*********************************************************************************************************************/
 
-/*Chip components*/
-extern uint8_t ram[4096];		//ram 4KB
-extern bool vram[64][32];		//display pixel data, 64x32 pixels
-extern uint8_t stackPointer;	//max 255 (0-255)
-extern uint16_t stack[256];		//stored addresses 16bit
-extern Reg16 PC, I; 			//16-bit Program Counter and Index Register
-extern Reg8 V[16];				//Register file with 16 general purpose registers 8 bit
-extern Reg8 timerDelay;			//Down counter, 8 bit, 60 Hz
-extern Reg8 timerSound;			//Down counter, 8 bit, 60 Hz, beep when non zero
+/*the chip, owned by the emulation thread*/
+extern Chip8 chip8;
 
 /*ROM*/
 extern const char* romFilename; //store ROM filename
 
+/*startup/reset*/
+extern uint8_t detectedMode;		//auto mode result for the loaded rom, 0 if not detected
+extern Memory pristineRam;			//ram right after loadFont/loadProgram, reset shares it again
+extern bool pristineValid;
+extern FileStamp configStamp;		//config.txt when last loaded
+extern FileStamp romStamp;			//ROM file when last loaded
+extern uint64_t startupTime;		//performance counter at start, 0 once the first frame is shown
+extern uint64_t resetRequestTime;	//performance counter at reset key
+
 /*SDL Rendering*/
 extern SDL_Window* window;		//SDL window
 extern SDL_Renderer* renderer;	//SDL renderer
+extern SDL_Texture* texture;	//rasterized frame, (64*scale)x(32*scale)
+extern int textureScale;		//scale texture was created with
 
 /*SDL Audio*/
-extern SDL_AudioSpec spec;		//tone audio specification
-extern SDL_AudioDeviceID dev;	//audio device
-extern WAVE_DATA_TYPE wave[WAVE_LENGTH];	//one wavelength data of tone
-
-/*For key presses, FX0A statemachine two bits, and event (close)*/
-extern bool keyIsPressed;		//key was pressed or not or released
-extern bool waitingKeyPress;	//waiting for a key press
-extern uint8_t pressedKeyHex;	//last pressed key
-extern SDL_Event e;				//SDL event queue, tells wether keyboard key pressed or close(X) button clicked
-extern bool quit;				//tell wether to quit app
+extern SDL_AudioSpec spec;		//obtained audio specification
+extern SDL_AudioDeviceID dev;	//audio device, 0 if none (set by the main thread before audioState is AUDIO_OPEN)
+extern atomic<uint8_t> audioState;	//AUDIO_*, see requestAudio() in audio.h
+extern AudioMixer mixer;		//device rate and format, one voice: chip8
+extern AudioVoice voice;
+extern uint8_t audioBuffer[AUDIO_MAX_TICK * 8 * 4];	//one tick, up to 8 channels of 32 bit samples
+
+/*For key presses (queued, applied to chip8.keys at frame boundaries), and event (close)*/
+extern KeyEvent keyQueue[KEY_QUEUE_SIZE];
+extern atomic<uint32_t> keyQueueHead;	//next event written, render thread
+extern atomic<uint32_t> keyQueueTail;	//next event read, emulation thread
+extern atomic<uint16_t> keysLatest;		//keypad after the last event queued (or not), render thread writes
+extern atomic<bool> keyQueueOverflow;	//an event found the queue full, applyKeys takes keysLatest instead
+extern uint16_t keysReleasing;			//released in the last batch while pressed in it, up at the next one
+extern SDL_Event e;						//SDL event queue, tells wether keyboard key pressed or close(X) button clicked
+extern atomic<bool> quit;				//tell wether to quit app
+extern atomic<bool> traceOnQuit;		//quit key: dump the execution trace on the way out
+extern atomic<bool> resetRequested;		//reset asked by render thread, done by emulation thread
+
+/*run ahead*/
+extern Chip8 aheadChip;				//speculative copy, rebuilt from chip8 every frame
+extern int frameCycles;				//instructions chip8 ran since the last frame tick
+extern int aheadCycles;				//instructions chip8 ran in the last frame, per frame of the copy
+
+/*frame handoff*/
+extern Frame frames[FRAME_BUFFERS];	//triple buffer
+extern uint8_t frameBack;			//being written, owned by emulation thread
+extern atomic<uint8_t> frameReady;	//last published, index | FRAME_FRESH
+extern uint8_t frameFront;			//on screen, owned by render thread
+extern uint32_t publishedVersion;	//chip8.vramVersion of the last publish
+extern bool frameSkipped;			//last back buffer was replaced before the render thread showed it
+
+/*input latency (performance counter stamps)*/
+extern uint64_t keyEventTime;			//oldest applied key event not yet seen by an instruction, 0 if none
+extern uint64_t latencyEventTime;		//key event seen by the emulation thread
+extern uint64_t latencyObserveTime;		//when an instruction saw it
+extern bool latencyArmed;				//waiting for vram to change after a key was seen
+extern uint32_t latencyVersion;			//chip8.vramVersion then, stamps go with the next publish after a change
+extern uint64_t latencyHistogram[3][LATENCY_BUCKETS];
+extern uint64_t latencySum[3];			//microseconds, for mean
+
+/*present timing*/
+extern uint64_t lastRenderCost;		//performance counter ticks spent drawing before present
+extern uint64_t lastPresentTime;	//when the last present returned (vsync: the vblank)
 
 /*timing*/
-extern uint32_t lastTimerUpdate;	//for down counter registers
+extern uint32_t timerStart;		//for down counter registers: ticks are paced from here
+extern uint64_t timerTicks;		//ticks since timerStart
 extern uint32_t lastFrameUpdate;	//for rendering
 extern uint32_t lastCPUExecute;//for cpu frequency 
 
-/*offline configuration */
+/*offline configuration, loaded by the main thread before the emulation thread starts, afterwards by it (reset)*/
+extern uint8_t chipMode;	//0: auto, chip8.mode is then detectedMode
 extern int scaleFactor;
 extern int displayWidth;
 extern int displayHeight;
 extern int enableDelay;
 extern int frequencyTimer;
 extern int frameRate;
+extern int runAhead;
 extern int frequencyCPU;
+extern int presentMode;
+extern int latencyStats;
+extern int scaleFilter;
 
 /*Functions***************************************************************************************************/
-void init();			//clear chip,  load config, load font, load rom
-void chip8Clear();		//clear all register, ram, vram
+void init();			//clear chip, load config, load font, load rom (config and rom only when changed on disk)
+bool fileChanged(const char* filename, FileStamp& stamp);	//compare with stamp and update it, true if changed or missing
 void loadConfig();		//load or creae config file with configurable options
-void loadFont();		//pre load font
-void loadProgram();		//read rom file
+void loadProgram();		//read rom file into the chip, detect its mode if CHIP_MODE is auto
+
+template <bool DEBUG> void cycle();		//one instruction, DEBUG engine adds breakpoints, stepping
 
-void push(uint16_t address);	//stack push
-uint16_t pop();					//stack pop
+void run();			//render thread loop, polls events and presents published frames until quit
+void runEmulation();	//emulation thread loop, runs the selected engine until quit
+template <bool DEBUG> void runEngine();	//emulate() with one engine until quit, reset or engine change
+template <bool DEBUG> void emulate();	//perform fetch, decode, execute, frame publish, audio with timing considereation
 
-uint16_t fetch();				//fetch next rom instruction
-void decodeandexecute(uint16_t instruction);	//decode and execute the instruction
+void publishFrame(const Chip8& chip);	//emulation thread: copy chip's vram (and render config) to back buffer and make it the ready frame
+void publishAhead();	//emulation thread: run a copy of the chip runAhead frames with the current keys, publish its vram
+bool acquireFrame();	//render thread: take the ready frame if fresh, returns false if nothing new
+void waitUntil(uint64_t time);	//sleep, then spin the last millisecond, until performance counter reaches time
+int displayRefreshRate();		//refresh rate of the window's display, 60 if unknown
 
-void run();			//infinite loop where emulator runs, also polls events
-void emulate();		//perform fetch, decode, execute, display, audio with timing considereation
+void observeKeys(Chip8& chip);	//onKeyRead hook of EX9E/EXA1/FX0A: stamp the first instruction seeing a new key event
+void recordLatency(Frame& frame, uint64_t presentTime);	//after present: add frame's stamps to histograms
+void reportLatency();	//print latency histograms
 
 void initDisplay();	//initialize SDL video 
-void clearDisplay();	//clear vram
-bool setPixel(uint8_t x, uint8_t y, bool bit);	//set pixel value by XORing bit with current pixel
-bool draw(uint8_t x, uint8_t y, uint8_t num);	//set #num pixels from (x,y)
-void renderToSDLWindow();	//update display window
+void setFrameConfig(Frame& frame);	//config globals render settings into frame
+void renderToSDLWindow();	//update display window with the front frame
+void captureFrame(const Frame& frame);	//save frame as CAPTURE_FILE (next free number)
 void renderToConsole();		//for debug, display vram with characters on the console window	
 
-int initAudio();			//initialize SDL audio, start audio device
-WAVE_DATA_TYPE getSineWaveSample();	//get circular wave data (one at a time), if wave data ends, next data starts from beginning
-void audioCallback(void* userdata, Uint8* stream, int len);	//callback functions when audio stream data ends (audio buffer empty). Provides spec.samples amount of data
+int initAudio();			//initialize SDL audio subsystem, open audio device, main thread once audioState is AUDIO_WANTED
+int sampleFormat(SDL_AudioFormat format);	//SAMPLE_* of an SDL format, -1 if audio.cpp does not write it
+void queueAudio();			//emulation thread, every timer tick if the device is open: one tick of chip8's sound
 
-void handleKeyDown();	//signal key press or quit action
+void handleKeyDown();	//queue keypad press, or quit/reset/capture
+void handleKeyUp();		//queue keypad release
+int keypadKey(SDL_Scancode scancode);	//hex key of a scancode, -1 if not on the keypad
+void queueKey(uint8_t key, bool down);	//render thread: add a key event (queue full: recorded in keysLatest only)
+void applyKeys();		//emulation thread, frame boundary: apply queued key events to chip8.keys
 
@@ -0,0 +1,176 @@
+#include "otlchip8.h"
+#include "chip8.h"
+#include "quirks.h"
+#include "raster.h"
+#include "audio.h"
+#include <new>
+
+
+/*machine plus its loaded image, reset goes back to it*/
+struct otl_chip8
+{
+	Chip8 chip;
+	Memory image;
+	int mode;		//as created, OTL_MODE_AUTO re-detects on every load
+	AudioMixer* mixer;	//otl_chip8_audio(), NULL until its first call (16KB+, most machines never ask), clones start without
+	AudioVoice voice;
+};
+
+
+int otl_chip8_api_version(void)
+{
+	return OTL_CHIP8_API_VERSION;
+}
+
+
+otl_chip8* otl_chip8_create(int mode)
+{
+	if (mode != OTL_MODE_AUTO && mode != OTL_MODE_COSMACVIP && mode != OTL_MODE_CHIP48 && mode != OTL_MODE_SUPERCHIP) return NULL;
+	otl_chip8* machine = new (std::nothrow) otl_chip8;
+	if (!machine) return NULL;
+	machine->mode = mode;
+	machine->mixer = NULL;
+	machine->voice.position = 0;
+	machine->voice.level = 0;
+	machine->chip.mode = mode ? (uint8_t)mode : CHIPMODE;
+	machine->image = machine->chip.ram;
+	return machine;
+}
+
+
+otl_chip8* otl_chip8_clone(const otl_chip8* chip)
+{
+	if (!chip) return NULL;
+	otl_chip8* copy = new (std::nothrow) otl_chip8(*chip);
+	if (!copy) return NULL;
+	copy->mixer = NULL;
+	copy->voice.position = 0;
+	copy->voice.level = 0;
+	return copy;
+}
+
+
+void otl_chip8_destroy(otl_chip8* chip)
+{
+	if (chip) delete chip->mixer;
+	delete chip;
+}
+
+
+int otl_chip8_load_rom(otl_chip8* chip, const uint8_t* rom, size_t size)
+{
+	if (!chip || (!rom && size)) return OTL_CHIP8_BAD_ARGUMENT;
+	if (size > MAX_ROM_SIZE) return OTL_CHIP8_TOO_LARGE;
+	if (chip->mode == OTL_MODE_AUTO) chip->chip.mode = detectMode(rom, size);
+	chip->chip.reset(rom, size);
+	chip->image = chip->chip.ram;
+	return OTL_CHIP8_OK;
+}
+
+
+void otl_chip8_reset(otl_chip8* chip)
+{
+	chip->chip.reset(chip->image);
+}
+
+
+int otl_chip8_mode(const otl_chip8* chip)
+{
+	return chip->chip.mode;
+}
+
+
+int otl_chip8_detect_mode(const uint8_t* rom, size_t size)
+{
+	if (!rom || size > MAX_ROM_SIZE) return CHIPMODE;
+	return detectMode(rom, size);
+}
+
+
+void otl_chip8_run_cycles(otl_chip8* chip, int cycles)
+{
+	for (int i = 0; i < cycles; ++i) chip->chip.step<false>();
+}
+
+
+void otl_chip8_timer_tick(otl_chip8* chip)
+{
+	chip->chip.timerTick();
+}
+
+
+void otl_chip8_run_frame(otl_chip8* chip, int cycles)
+{
+	chip->chip.runFrame(cycles);
+}
+
+
+void otl_chip8_set_keys(otl_chip8* chip, uint16_t keys)
+{
+	chip->chip.keys = keys;
+}
+
+
+void otl_chip8_set_key(otl_chip8* chip, int key, int pressed)
+{
+	uint16_t bit = 1 << (key & 0x0F);
+	if (pressed) chip->chip.keys |= bit;
+	else chip->chip.keys &= ~bit;
+}
+
+
+int otl_chip8_sound(const otl_chip8* chip)
+{
+	return chip->chip.timerSound != 0;
+}
+
+
+int otl_chip8_audio(otl_chip8* chip, int rate, float* samples, int max)
+{
+	if (rate <= 0 || !samples) return 0;
+	if (!chip->mixer && !(chip->mixer = new (std::nothrow) AudioMixer())) return 0;
+	AudioMixer& mixer = *chip->mixer;
+	if (mixer.rate != rate) initMixer(mixer, rate, 1, SAMPLE_F32, 60);
+	uint64_t ticks = mixer.ticks;
+	if (beginTick(mixer) > max)
+	{
+		mixer.ticks = ticks; //nothing written, same tick next call
+		return 0;
+	}
+	mixVoice(mixer, chip->voice, chip->chip);
+	return endTick(mixer, samples) / (int)sizeof(float);
+}
+
+
+uint32_t otl_chip8_frame_version(const otl_chip8* chip)
+{
+	return chip->chip.vramVersion;
+}
+
+
+void otl_chip8_framebuffer(const otl_chip8* chip, uint8_t pixels[OTL_CHIP8_WIDTH * OTL_CHIP8_HEIGHT])
+{
+	for (int y = 0; y < OTL_CHIP8_HEIGHT; ++y)
+		for (int x = 0; x < OTL_CHIP8_WIDTH; ++x)
+			pixels[y * OTL_CHIP8_WIDTH + x] = chip->chip.vram[x][y];
+}
+
+
+void otl_chip8_framebuffer_rows(const otl_chip8* chip, uint64_t rows[OTL_CHIP8_HEIGHT])
+{
+	chip->chip.packRows(rows);
+}
+
+
+uint64_t otl_chip8_framebuffer_hash(const otl_chip8* chip)
+{
+	return chip->chip.vramHash();
+}
+
+
+void otl_chip8_render(const otl_chip8* chip, uint32_t* pixels, int pitch, int scale, uint32_t on, uint32_t off)
+{
+	uint64_t rows[OTL_CHIP8_HEIGHT];
+	chip->chip.packRows(rows);
+	rasterize(rows, pixels, pitch, scale > 0 ? scale : 1, FILTER_NONE, on, off);
+}
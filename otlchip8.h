@@ -0,0 +1,79 @@
+#pragma once
+
+/*
+* otlchip8 library, C API: the interpreter without SDL, threads or globals.
+* Link libotlchip8.a (or libotlchip8.so), include only this header.
+* One machine must not be used by two threads at once, different machines may run in parallel.
+* Stable: functions are only added, OTL_CHIP8_API_VERSION goes up when they are.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define OTL_CHIP8_API_VERSION	3
+
+/*exported: the library is built with -fvisibility=hidden, only otl_* functions are visible in libotlchip8.so*/
+#if defined(__GNUC__)
+#define OTL_API		__attribute__((visibility("default")))
+#else
+#define OTL_API
+#endif
+
+/*chip modes (same values as CHIP_MODE in config.txt)*/
+#define OTL_MODE_AUTO			0	//detect, see otl_chip8_detect_mode()
+#define OTL_MODE_COSMACVIP		1
+#define OTL_MODE_CHIP48			2
+#define OTL_MODE_SUPERCHIP		4
+
+/*display*/
+#define OTL_CHIP8_WIDTH			64
+#define OTL_CHIP8_HEIGHT		32
+
+/*results*/
+#define OTL_CHIP8_OK			0
+#define OTL_CHIP8_TOO_LARGE		-1	//rom does not fit (3584 bytes max), nothing loaded
+#define OTL_CHIP8_BAD_ARGUMENT	-2
+
+/**Type Definitions********************************************************************************************************************/
+
+typedef struct otl_chip8 otl_chip8;	//opaque machine
+
+/*Functions***************************************************************************************************/
+
+OTL_API int otl_chip8_api_version(void);	//OTL_CHIP8_API_VERSION the library was built with
+
+OTL_API otl_chip8* otl_chip8_create(int mode);			//empty machine, NULL if out of memory or mode is not an OTL_MODE_*, AUTO picks at load
+OTL_API otl_chip8* otl_chip8_clone(const otl_chip8* chip);	//same state, ram pages shared until written (cheap), sound of otl_chip8_audio() starts anew
+OTL_API void otl_chip8_destroy(otl_chip8* chip);			//NULL is fine
+
+OTL_API int otl_chip8_load_rom(otl_chip8* chip, const uint8_t* rom, size_t size);	//reset, font, rom at 0x200. OTL_CHIP8_OK or error
+OTL_API void otl_chip8_reset(otl_chip8* chip);				//back to the state right after the last load
+OTL_API int otl_chip8_mode(const otl_chip8* chip);			//mode in use (detected one if created with AUTO)
+OTL_API int otl_chip8_detect_mode(const uint8_t* rom, size_t size);	//run the rom under all modes (a few ms, threads), best mode
+
+OTL_API void otl_chip8_run_cycles(otl_chip8* chip, int cycles);		//instructions only, no timers
+OTL_API void otl_chip8_timer_tick(otl_chip8* chip);					//60 Hz delay/sound timer decrement
+OTL_API void otl_chip8_run_frame(otl_chip8* chip, int cycles);		//cycles instructions then one timer tick
+
+OTL_API void otl_chip8_set_key(otl_chip8* chip, int key, int pressed);	//key 0x0-0xF down (1) or up (0), other keys unchanged
+OTL_API void otl_chip8_set_keys(otl_chip8* chip, uint16_t keys);		//whole keypad, bit k is key k (since version 2)
+OTL_API int otl_chip8_sound(const otl_chip8* chip);						//1 while the sound timer runs (beep)
+//sound of one 60 Hz tick, call once after each run_frame/timer_tick: mono -1..1 at rate (same rate every call),
+//XO-CHIP pattern and pitch, band limited, no audio device needed. Samples written (rate/60), 0 if max is too small (since version 3)
+OTL_API int otl_chip8_audio(otl_chip8* chip, int rate, float* samples, int max);
+
+OTL_API uint32_t otl_chip8_frame_version(const otl_chip8* chip);	//changes whenever the display may have changed
+OTL_API void otl_chip8_framebuffer(const otl_chip8* chip, uint8_t pixels[OTL_CHIP8_WIDTH * OTL_CHIP8_HEIGHT]);	//row major, 1 lit, 0 dark
+OTL_API void otl_chip8_framebuffer_rows(const otl_chip8* chip, uint64_t rows[OTL_CHIP8_HEIGHT]);	//packed, rows[y] bit 63 is x=0
+OTL_API uint64_t otl_chip8_framebuffer_hash(const otl_chip8* chip);	//FNV-1a of the display (same as the conformance runner)
+OTL_API void otl_chip8_render(const otl_chip8* chip, uint32_t* pixels, int pitch, int scale, uint32_t on, uint32_t off);	//ARGB, (64*scale)x(32*scale), pitch in pixels
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,159 @@
+#include "quirks.h"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+//scripted input: common start/move keys, one press every DETECT_KEY_PERIOD frames
+static const uint8_t detectKeys[] = { 0x5, 0x4, 0x6, 0x2, 0x8, 0x1, 0xA, 0xF, 0x0, 0xE };
+
+
+//trouble seen running the rom in one mode, thumbnail (NULL: not wanted) gets the busiest sampled screen
+static uint64_t scoreMode(const uint8_t* rom, size_t size, uint8_t mode, uint64_t* thumbnail)
+{
+	Chip8* chip = new Chip8(); //one per thread, off the stack
+	chip->mode = mode;
+	chip->reset(rom, size);
+
+	uint32_t halfway = 0;
+	int busiest = -1;
+	for (int f = 0; f < DETECT_FRAMES; ++f)
+	{
+		int phase = f % DETECT_KEY_PERIOD;
+		bool down = phase >= DETECT_KEY_PERIOD - DETECT_KEY_FRAMES;
+		chip->keys = down ? 1 << detectKeys[f / DETECT_KEY_PERIOD % sizeof(detectKeys)] : 0;
+		chip->runFrame(DETECT_CYCLES);
+		if (f == DETECT_FRAMES / 2) halfway = chip->vramVersion;
+
+		//sampled just before each scripted key, most lit pixels wins (title screens, playfields, not blank or half drawn)
+		if (thumbnail && phase == DETECT_KEY_PERIOD - DETECT_KEY_FRAMES - 1)
+		{
+			uint64_t rows[32];
+			chip->packRows(rows);
+			int lit = 0;
+			for (int y = 0; y < 32; ++y) lit += popCount64(rows[y]);
+			if (lit > busiest)
+			{
+				busiest = lit;
+				memcpy(thumbnail, rows, sizeof(rows));
+			}
+		}
+	}
+
+	bool blank = true;
+	for (int x = 0; x < CHIP8_DISPLAY_WIDTH && blank; ++x)
+		for (int y = 0; y < CHIP8_DISPLAY_HEIGHT; ++y)
+			if (chip->vram[x][y]) { blank = false; break; }
+
+	uint64_t score = (uint64_t)(chip->faults[FAULT_STACK] + (uint64_t)chip->faults[FAULT_PC]) * SCORE_FAULT
+		+ (uint64_t)chip->faults[FAULT_OPCODE] * SCORE_OPCODE;
+	if (blank) score += SCORE_BLANK;
+	if (chip->vramVersion == halfway) score += SCORE_FROZEN;
+	delete chip;
+	return score;
+}
+
+
+uint8_t detectMode(const uint8_t* rom, size_t size, uint64_t scores[3])
+{
+	const uint8_t modes[3] = { COSMACVIP, CHIP48, SUPERCHIP };
+	uint64_t results[3];
+	thread runs[3];
+	for (int m = 0; m < 3; ++m) runs[m] = thread([=, &results]() { results[m] = scoreMode(rom, size, modes[m], NULL); });
+	for (int m = 0; m < 3; ++m) runs[m].join();
+
+	int best = 0;
+	for (int m = 1; m < 3; ++m) if (results[m] < results[best]) best = m;
+	if (scores) memcpy(scores, results, sizeof(results));
+	return modes[best];
+}
+
+
+uint8_t detectModeSerial(const uint8_t* rom, size_t size, uint64_t thumbnail[32])
+{
+	const uint8_t modes[3] = { COSMACVIP, CHIP48, SUPERCHIP };
+	uint64_t thumbnails[3][32];
+	int best = 0;
+	uint64_t bestScore = 0;
+	for (int m = 0; m < 3; ++m)
+	{
+		uint64_t score = scoreMode(rom, size, modes[m], thumbnails[m]);
+		if (m == 0 || score < bestScore)
+		{
+			best = m;
+			bestScore = score;
+		}
+	}
+	memcpy(thumbnail, thumbnails[best], sizeof(thumbnails[best]));
+	return modes[best];
+}
+
+
+//quirks.db is a text file anyone can edit, only real modes count
+static bool knownMode(int mode)
+{
+	return mode == COSMACVIP || mode == CHIP48 || mode == SUPERCHIP;
+}
+
+
+void storeModes(const uint64_t* hashes, const uint8_t* modes, size_t count)
+{
+	//hashes already there, read once
+	vector<uint64_t> known;
+	FILE* file = fopen(QUIRKS_FILE, "r");
+	if (file)
+	{
+		char line[128];
+		unsigned long long entry;
+		int mode;
+		while (fgets(line, sizeof(line), file))
+			if (sscanf(line, "%llx %d", &entry, &mode) == 2 && knownMode(mode)) known.push_back(entry);
+		fclose(file);
+	}
+	sort(known.begin(), known.end());
+
+	file = fopen(QUIRKS_FILE, "a");
+	if (!file) return;
+	for (size_t i = 0; i < count; ++i)
+	{
+		if (binary_search(known.begin(), known.end(), hashes[i])) continue;
+		fprintf(file, "%016llx %d\n", (unsigned long long)hashes[i], modes[i]);
+	}
+	fclose(file);
+}
+
+
+uint8_t autoMode(const uint8_t* rom, size_t size, bool* cached, uint64_t scores[3])
+{
+	uint64_t hash = hashBytes(rom, size);
+
+	FILE* file = fopen(QUIRKS_FILE, "r");
+	if (file)
+	{
+		char line[128];
+		unsigned long long entry;
+		int mode;
+		while (fgets(line, sizeof(line), file))
+		{
+			if (sscanf(line, "%llx %d", &entry, &mode) != 2 || entry != hash || !knownMode(mode)) continue;	//bad mode: detect again
+			fclose(file);
+			*cached = true;
+			return (uint8_t)mode;
+		}
+		fclose(file);
+	}
+
+	*cached = false;
+	uint8_t mode = detectMode(rom, size, scores);
+	file = fopen(QUIRKS_FILE, "a");
+	if (file)
+	{
+		fprintf(file, "%016llx %d\n", (unsigned long long)hash, mode);
+		fclose(file);
+	}
+	return mode;
+}
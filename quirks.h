@@ -0,0 +1,34 @@
+#pragma once
+
+/*
+* Chip mode auto detection: the rom runs headless under every mode at once,
+* the mode showing the fewest signs of trouble wins. Results are kept in QUIRKS_FILE by rom hash.
+* No SDL here.
+*/
+
+#include "chip8.h"
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define QUIRKS_FILE			"quirks.db"	//"<rom hash> <chip mode>" lines
+#define DETECT_FRAMES		600			//frames per mode (10 s of game time)
+#define DETECT_CYCLES		1000		//instructions per frame
+#define DETECT_KEY_PERIOD	30			//frames between scripted key presses (get past title screens)
+#define DETECT_KEY_FRAMES	4			//frames a scripted key is held
+
+/*score weights, lowest score wins*/
+#define SCORE_FAULT			100		//per stack/PC fault, a right mode almost never has one
+#define SCORE_OPCODE		10		//per invalid instruction
+#define SCORE_BLANK			50		//screen empty at the end
+#define SCORE_FROZEN		20		//screen unchanged for the second half
+
+/*Functions***************************************************************************************************/
+
+//mode for the rom: from QUIRKS_FILE (COSMACVIP, CHIP48 or SUPERCHIP only), else detected and added there. cached tells which, scores (if not NULL) are set when detected
+uint8_t autoMode(const uint8_t* rom, size_t size, bool* cached, uint64_t scores[3] = NULL);
+//run the rom under COSMACVIP, CHIP48, SUPERCHIP in parallel, best mode (COSMACVIP on a tie), scores (if not NULL) in that order
+uint8_t detectMode(const uint8_t* rom, size_t size, uint64_t scores[3] = NULL);
+//same on the calling thread (callers run many roms in parallel), thumbnail: busiest screen seen in the best mode
+uint8_t detectModeSerial(const uint8_t* rom, size_t size, uint64_t thumbnail[32]);
+//add "<hash> <mode>" lines to QUIRKS_FILE for hashes not in it yet, reads it once
+void storeModes(const uint64_t* hashes, const uint8_t* modes, size_t count);
@@ -0,0 +1,233 @@
+#include "raster.h"
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RASTER_SSE2
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RASTER_NEON
+#endif
+
+
+/*
+* Expansion table: one byte of a packed row => masks of its 8 pixels (all ones when set).
+* Color is applied as off ^ (mask & (on ^ off)), so the table does not depend on colors
+* and is built once (thread safe static).
+*/
+typedef struct ExpandTable
+{
+	alignas(16) uint32_t masks[256][8];
+	ExpandTable()
+	{
+		for (int b = 0; b < 256; ++b)
+			for (int p = 0; p < 8; ++p)
+				masks[b][p] = (b >> (7 - p)) & 1 ? 0xFFFFFFFF : 0;
+	}
+} ExpandTable;
+
+
+static const ExpandTable& expandTable()
+{
+	static const ExpandTable table;
+	return table;
+}
+
+
+//bit i => bit 2i
+static uint64_t spreadBits(uint32_t bits)
+{
+	uint64_t x = bits;
+	x = (x | x << 16) & 0x0000FFFF0000FFFFull;
+	x = (x | x << 8) & 0x00FF00FF00FF00FFull;
+	x = (x | x << 4) & 0x0F0F0F0F0F0F0F0Full;
+	x = (x | x << 2) & 0x3333333333333333ull;
+	x = (x | x << 1) & 0x5555555555555555ull;
+	return x;
+}
+
+
+/*
+* Scale2x (EPX) on packed rows, 64 pixels at a time with bit operations.
+*	  B			E0 E1
+*	D E F  =>	E2 E3
+*	  H
+* E0 = D if D==B, B!=H, D!=F, else E (same pattern for the other three corners)
+* Pixels outside the image repeat the edge.
+*/
+static void scale2x(const uint64_t* in, int words, int height, uint64_t* out)
+{
+	for (int y = 0; y < height; ++y)
+	{
+		const uint64_t* rowE = in + y * words;
+		const uint64_t* rowB = y ? rowE - words : rowE;
+		const uint64_t* rowH = y < height - 1 ? rowE + words : rowE;
+		uint64_t* top = out + 4 * y * words;
+		uint64_t* bottom = top + 2 * words;
+
+		for (int w = 0; w < words; ++w)
+		{
+			uint64_t E = rowE[w], B = rowB[w], H = rowH[w];
+			uint64_t D = E >> 1 | (w ? rowE[w - 1] << 63 : E & (1ull << 63));	//left neighbours
+			uint64_t F = E << 1 | (w < words - 1 ? rowE[w + 1] >> 63 : E & 1);	//right neighbours
+
+			uint64_t edge = (B ^ H) & (D ^ F);
+			uint64_t m0 = edge & ~(D ^ B), m1 = edge & ~(B ^ F), m2 = edge & ~(D ^ H), m3 = edge & ~(H ^ F);
+			uint64_t E0 = (m0 & D) | (~m0 & E);
+			uint64_t E1 = (m1 & F) | (~m1 & E);
+			uint64_t E2 = (m2 & D) | (~m2 & E);
+			uint64_t E3 = (m3 & F) | (~m3 & E);
+
+			//interleave, left pixel is the higher bit
+			top[2 * w] = spreadBits((uint32_t)(E0 >> 32)) << 1 | spreadBits((uint32_t)(E1 >> 32));
+			top[2 * w + 1] = spreadBits((uint32_t)E0) << 1 | spreadBits((uint32_t)E1);
+			bottom[2 * w] = spreadBits((uint32_t)(E2 >> 32)) << 1 | spreadBits((uint32_t)(E3 >> 32));
+			bottom[2 * w + 1] = spreadBits((uint32_t)E2) << 1 | spreadBits((uint32_t)E3);
+		}
+	}
+}
+
+
+//one packed row => width*scale pixels
+static void expandRow(const uint64_t* bits, int width, int scale, uint32_t* out, uint32_t on, uint32_t off)
+{
+	const ExpandTable& table = expandTable();
+	uint32_t diff = on ^ off;
+#ifdef RASTER_SSE2
+	__m128i offv = _mm_set1_epi32((int)off), diffv = _mm_set1_epi32((int)diff);
+#elif defined(RASTER_NEON)
+	uint32x4_t offv = vdupq_n_u32(off), diffv = vdupq_n_u32(diff);
+#endif
+
+	for (int k = 0; k < width / 8; ++k)
+	{
+		uint8_t b = (uint8_t)(bits[k >> 3] >> (56 - ((k & 7) << 3)));
+		const uint32_t* mask = table.masks[b];
+		uint32_t* dst = out + k * 8 * scale;
+
+#ifdef RASTER_SSE2
+		//8 colored pixels in two registers, then widen by shuffles or repeated stores
+		__m128i lo = _mm_xor_si128(offv, _mm_and_si128(_mm_load_si128((const __m128i*)mask), diffv));
+		__m128i hi = _mm_xor_si128(offv, _mm_and_si128(_mm_load_si128((const __m128i*)(mask + 4)), diffv));
+		if (scale == 1)
+		{
+			_mm_storeu_si128((__m128i*)dst, lo);
+			_mm_storeu_si128((__m128i*)(dst + 4), hi);
+			continue;
+		}
+		if (scale == 2)
+		{
+			_mm_storeu_si128((__m128i*)dst, _mm_unpacklo_epi32(lo, lo));
+			_mm_storeu_si128((__m128i*)(dst + 4), _mm_unpackhi_epi32(lo, lo));
+			_mm_storeu_si128((__m128i*)(dst + 8), _mm_unpacklo_epi32(hi, hi));
+			_mm_storeu_si128((__m128i*)(dst + 12), _mm_unpackhi_epi32(hi, hi));
+			continue;
+		}
+		if (scale >= 4)
+		{
+			__m128i pixel[8] = { _mm_shuffle_epi32(lo, 0x00), _mm_shuffle_epi32(lo, 0x55), _mm_shuffle_epi32(lo, 0xAA), _mm_shuffle_epi32(lo, 0xFF),
+								 _mm_shuffle_epi32(hi, 0x00), _mm_shuffle_epi32(hi, 0x55), _mm_shuffle_epi32(hi, 0xAA), _mm_shuffle_epi32(hi, 0xFF) };
+			for (int p = 0; p < 8; ++p)
+			{
+				uint32_t* d = dst + p * scale;
+				int i = 0;
+				for (; i + 4 <= scale; i += 4) _mm_storeu_si128((__m128i*)(d + i), pixel[p]);
+				if (i < scale) _mm_storeu_si128((__m128i*)(d + scale - 4), pixel[p]); //overlaps, same color
+			}
+			continue;
+		}
+#elif defined(RASTER_NEON)
+		uint32x4_t lo = veorq_u32(offv, vandq_u32(vld1q_u32(mask), diffv));
+		uint32x4_t hi = veorq_u32(offv, vandq_u32(vld1q_u32(mask + 4), diffv));
+		if (scale == 1)
+		{
+			vst1q_u32(dst, lo);
+			vst1q_u32(dst + 4, hi);
+			continue;
+		}
+		if (scale == 2)
+		{
+			uint32x4x2_t a = vzipq_u32(lo, lo), c = vzipq_u32(hi, hi);
+			vst1q_u32(dst, a.val[0]);
+			vst1q_u32(dst + 4, a.val[1]);
+			vst1q_u32(dst + 8, c.val[0]);
+			vst1q_u32(dst + 12, c.val[1]);
+			continue;
+		}
+		if (scale >= 4)
+		{
+			for (int p = 0; p < 8; ++p)
+			{
+				uint32x4_t pixel = vdupq_n_u32(off ^ (mask[p] & diff));
+				uint32_t* d = dst + p * scale;
+				int i = 0;
+				for (; i + 4 <= scale; i += 4) vst1q_u32(d + i, pixel);
+				if (i < scale) vst1q_u32(d + scale - 4, pixel);
+			}
+			continue;
+		}
+#endif
+		for (int p = 0; p < 8; ++p)
+		{
+			uint32_t pixel = off ^ (mask[p] & diff);
+			for (int i = 0; i < scale; ++i) dst[p * scale + i] = pixel;
+		}
+	}
+}
+
+
+void rasterize(const uint64_t rows[32], uint32_t* pixels, int pitch, int scale, int filter, uint32_t on, uint32_t off)
+{
+	if (filter == FILTER_SCALE4X && scale % 4) filter = FILTER_SCALE2X;
+	if (filter == FILTER_SCALE2X && scale % 2) filter = FILTER_NONE;
+
+	//smoothing doubles the image and halves the remaining integer scale
+	uint64_t image2x[2 * 64], image4x[4 * 128];
+	const uint64_t* image = rows;
+	int words = 1, height = 32;
+	if (filter == FILTER_SCALE2X || filter == FILTER_SCALE4X)
+	{
+		scale2x(image, words, height, image2x);
+		image = image2x;
+		words *= 2; height *= 2; scale /= 2;
+	}
+	if (filter == FILTER_SCALE4X)
+	{
+		scale2x(image, words, height, image4x);
+		image = image4x;
+		words *= 2; height *= 2; scale /= 2;
+	}
+
+	//expand each row once, repeat it for the vertical scale
+	int width = words * 64 * scale;
+	for (int y = 0; y < height; ++y)
+	{
+		uint32_t* line = pixels + (size_t)y * scale * pitch;
+		expandRow(image + y * words, words * 64, scale, line, on, off);
+		for (int i = 1; i < scale; ++i) memcpy(line + (size_t)i * pitch, line, width * sizeof(uint32_t));
+	}
+}
+
+
+bool writePPM(const char* filename, const uint32_t* pixels, int width, int height, int pitch)
+{
+	FILE* file = fopen(filename, "wb");
+	if (file == NULL) return false;
+
+	fprintf(file, "P6\n%d %d\n255\n", width, height);
+	uint8_t* rgb = new uint8_t[width * 3];
+	for (int y = 0; y < height; ++y)
+	{
+		const uint32_t* row = pixels + (size_t)y * pitch;
+		for (int x = 0; x < width; ++x)
+		{
+			rgb[3 * x] = (uint8_t)(row[x] >> 16);
+			rgb[3 * x + 1] = (uint8_t)(row[x] >> 8);
+			rgb[3 * x + 2] = (uint8_t)row[x];
+		}
+		fwrite(rgb, 3, width, file);
+	}
+	delete[] rgb;
+	return fclose(file) == 0;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/*
+* CPU rasterizer: packed 1-bit rows => scaled 32-bit pixels in a caller provided buffer.
+* Used for the SDL texture and for captures, no SDL here.
+*/
+
+#include <stdint.h>
+
+/*MACRO definitions**************************************************************************************************************************/
+
+/*smoothing before integer scaling*/
+#define FILTER_NONE		0	//square pixels
+#define FILTER_SCALE2X	1	//Scale2x (EPX) edge smoothing, needs an even scale
+#define FILTER_SCALE4X	2	//Scale2x twice, needs a scale multiple of 4
+
+/*colors, ARGB8888*/
+#define PIXEL_ON		0xFFFFFFFF	//white
+#define PIXEL_OFF		0xFF000000	//black
+
+/*Functions***************************************************************************************************/
+
+//64x32 image, rows[y] bit 63 is x=0 (Chip8::packRows). Writes (64*scale)x(32*scale) pixels, pitch in pixels.
+//A filter the scale does not allow is reduced (4x => 2x => none).
+void rasterize(const uint64_t rows[32], uint32_t* pixels, int pitch, int scale, int filter, uint32_t on, uint32_t off);
+
+//binary PPM (P6) of ARGB pixels, false if it could not be written
+bool writePPM(const char* filename, const uint32_t* pixels, int width, int height, int pitch);
@@ -0,0 +1,66 @@
+#include "main.h"
+#include "trace.h"
+#include <signal.h>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define open	_open
+#define write	_write
+#define close	_close
+#define TRACE_OPEN_FLAGS	(_O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY)
+#else
+#include <unistd.h>
+#define TRACE_OPEN_FLAGS	(O_WRONLY | O_CREAT | O_TRUNC)
+#endif
+
+
+/*always on, chip8.step() writes it after every instruction (chip8.traceHead counts them)*/
+uint64_t traceRing[TRACE_ENTRIES];
+
+
+void dumpTrace(int reason)
+{
+	//only open/write/close, may run inside a signal handler
+	TraceHeader header;
+	memcpy(header.magic, TRACE_MAGIC, 4);
+	header.version = TRACE_VERSION;
+	header.entries = TRACE_ENTRIES;
+	header.reason = reason;
+	header.head = chip8.traceHead;
+	header.mode = chip8.mode;
+	header.reserved = 0;
+
+	int file = open(TRACE_FILE, TRACE_OPEN_FLAGS, 0644);
+	if (file < 0) return;
+	write(file, &header, sizeof(header));
+	write(file, traceRing, sizeof(traceRing));
+	close(file);
+}
+
+
+void traceSignal(int sig)
+{
+	dumpTrace(sig);
+#ifdef SIGUSR1
+	if (sig == SIGUSR1) return; //dump on request, keep running
+#endif
+	//crash: default action (core dump, exit status) after the dump
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+
+void installTraceHandlers()
+{
+	signal(SIGSEGV, traceSignal);
+	signal(SIGABRT, traceSignal);
+	signal(SIGFPE, traceSignal);
+	signal(SIGILL, traceSignal);
+#ifdef SIGBUS
+	signal(SIGBUS, traceSignal);
+#endif
+#ifdef SIGUSR1
+	signal(SIGUSR1, traceSignal);
+#endif
+}
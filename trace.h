@@ -0,0 +1,58 @@
+#pragma once
+
+/*
+* Execution trace, shared by the emulator (recording, dump) and tracedecode (reading).
+* No SDL here, tracedecode is built without it.
+*/
+
+#include <stdint.h>
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define TRACE_ENTRIES		(1 << 16)		//ring size, power of 2 (512 KB)
+#define TRACE_MASK			(TRACE_ENTRIES - 1)
+#define TRACE_FILE			"trace.bin"		//dump file
+#define TRACE_MAGIC			"C8TR"
+#define TRACE_VERSION		1
+#define TRACE_REASON_QUIT	0				//dump reason if not a signal number
+
+/*
+* entry, 8 bytes, state after the instruction:
+* bits  0-15 : opcode
+* bits 16-27 : PC of the opcode
+* bits 28-39 : I
+* bits 40-47 : VX (X of the opcode)
+* bits 48-55 : VF
+* bits 56-63 : stack pointer
+* Everything an instruction changes is in there except the rest of V0-VX for FX65.
+*/
+#define TRACE_PACK(pc, op, i, vx, vf, sp)	((uint64_t)(op) | (uint64_t)((pc) & 0x0FFF) << 16 | (uint64_t)((i) & 0x0FFF) << 28 | \
+											(uint64_t)(vx) << 40 | (uint64_t)(vf) << 48 | (uint64_t)(sp) << 56)
+#define TRACE_OP(entry)		((uint16_t)(entry))
+#define TRACE_PC(entry)		((uint16_t)((entry) >> 16) & 0x0FFF)
+#define TRACE_I(entry)		((uint16_t)((entry) >> 28) & 0x0FFF)
+#define TRACE_VX(entry)		((uint8_t)((entry) >> 40))
+#define TRACE_VF(entry)		((uint8_t)((entry) >> 48))
+#define TRACE_SP(entry)		((uint8_t)((entry) >> 56))
+
+/**Type Definitions********************************************************************************************************************/
+
+//dump file: header, then the ring as it is in memory (oldest entry at head & TRACE_MASK once wrapped)
+typedef struct TraceHeader
+{
+	char magic[4];		//TRACE_MAGIC
+	uint32_t version;	//TRACE_VERSION
+	uint32_t entries;	//ring size
+	uint32_t reason;	//signal number or TRACE_REASON_QUIT
+	uint64_t head;		//instructions recorded so far
+	uint32_t mode;		//chip mode
+	uint32_t reserved;
+} TraceHeader;
+
+/**Global Variables*********************************************************************************************************************/
+
+extern uint64_t traceRing[TRACE_ENTRIES];	//emulator only, chip8.trace points here
+
+/*Functions***************************************************************************************************/
+void installTraceHandlers();	//dump on crash signals (and SIGUSR1 without stopping)
+void dumpTrace(int reason);		//write TRACE_FILE, async signal safe
@@ -0,0 +1,90 @@
+/*
+* tracedecode: turn an execution trace dump (trace.bin) into a disassembly with register changes.
+* usage: tracedecode [trace file] [last n instructions]
+*/
+
+#include "trace.h"
+#include "disasm.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+using namespace std;
+
+
+int main(int argc, char* argv[])
+{
+	const char* filename = argc > 1 ? argv[1] : TRACE_FILE;
+	uint64_t limit = argc > 2 ? strtoull(argv[2], NULL, 10) : 0;
+
+	FILE* file = fopen(filename, "rb");
+	if (!file)
+	{
+		printf("could not open %s\n", filename);
+		return 1;
+	}
+
+	TraceHeader header;
+	if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, TRACE_MAGIC, 4) || header.version != TRACE_VERSION
+		|| !header.entries || (header.entries & (header.entries - 1)))
+	{
+		printf("%s is not a trace dump\n", filename);
+		fclose(file);
+		return 1;
+	}
+
+	vector<uint64_t> ring(header.entries);
+	size_t got = fread(ring.data(), sizeof(uint64_t), header.entries, file);
+	fclose(file);
+	if (got != header.entries)
+	{
+		printf("%s is truncated\n", filename);
+		return 1;
+	}
+
+	//oldest entry first, ring wraps after header.entries instructions
+	uint64_t count = header.head < header.entries ? header.head : header.entries;
+	if (limit && limit < count) count = limit;
+	uint64_t first = header.head - count;
+
+	printf("trace %s: %llu instructions executed, last %llu shown, mode %u, ", filename,
+		(unsigned long long)header.head, (unsigned long long)count, header.mode);
+	if (header.reason == TRACE_REASON_QUIT) printf("dumped on quit\n");
+	else printf("dumped on signal %u\n", header.reason);
+	printf("%12s  %-4s  %-4s  %-18s %s\n", "#", "PC", "op", "instruction", "changes");
+
+	//previous state, to show what changed (unknown before the first shown entry)
+	bool known = false;
+	uint16_t lastI = 0;
+	uint8_t lastVF = 0, lastSP = 0;
+
+	for (uint64_t n = first; n < header.head; ++n)
+	{
+		uint64_t entry = ring[n & (header.entries - 1)];
+		uint16_t op = TRACE_OP(entry);
+
+		char text[32];
+		disassemble(op, text, sizeof(text));
+		printf("%12llu  %03X   %04X  %-18s", (unsigned long long)n, TRACE_PC(entry), op, text);
+
+		//register written by the opcode, then anything else that moved
+		int target = instructionTarget(op);
+		int x = (op & 0x0F00) >> 8;
+		if (target >= 0 && target < 16)
+		{
+			if ((op & 0xF0FF) == 0xF065 && x) printf(" V0-V%X loaded, V%X=%02X", x, x, TRACE_VX(entry));
+			else printf(" V%X=%02X", x, TRACE_VX(entry));
+		}
+		if (target == TARGET_I || (known && TRACE_I(entry) != lastI)) printf(" I=%03X", TRACE_I(entry));
+		if (known && TRACE_VF(entry) != lastVF && !(target == 0xF)) printf(" VF=%02X", TRACE_VF(entry));
+		if (known && TRACE_SP(entry) != lastSP) printf(" SP=%02X", TRACE_SP(entry));
+		printf("\n");
+
+		known = true;
+		lastI = TRACE_I(entry);
+		lastVF = TRACE_VF(entry);
+		lastSP = TRACE_SP(entry);
+	}
+	return 0;
+}
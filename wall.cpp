@@ -0,0 +1,299 @@
+/*
+* wall: many machines on one window, for watching a lot of running instances at once.
+* usage: wall [--count n] [--mode m] [--threads t] [--scale s] <rom> [rom ...]
+*	--count   : machines, roms are used in turn (default one per rom)
+*	--mode    : chip mode for all, 0 auto per rom (default, quirks.db as in otlchip8x)
+*	--threads : emulation threads (default all cores)
+*	--scale   : pixel size of a tile (default WALL_SCALE, smaller if the atlas would not fit the gpu)
+*
+* All tiles live in one atlas texture, drawn with one copy and one present per refresh.
+* A machine publishes its screen only when vram changed and marks its tile dirty,
+* the render thread rasterizes and uploads dirty tiles only: cost follows the tiles that change,
+* not the number of machines. ESC or closing the window quits.
+*/
+
+#include "chip8.h"
+#include "quirks.h"
+#include "raster.h"
+#include "SDL.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+/*MACRO definitions**************************************************************************************************************************/
+
+#define WALL_SCALE			2			//tile pixel size, 64x32 => 128x64
+#define WALL_GAP			2			//atlas pixels between tiles
+#define WALL_GAP_COLOR		0xFF303030	//gaps and empty cells, ARGB8888
+#define WALL_FRAME_RATE		60			//machine frames per second
+#define WALL_CYCLES			(700 / 60)	//instructions per frame, FREQUENCY_CPU / FRAME_RATE defaults
+
+/*per tile frame handoff, as frames in main.cpp (lock-free triple buffer)*/
+#define TILE_BUFFERS	3
+#define TILE_INDEX		0x03
+#define TILE_FRESH		0x04
+
+/**Type Definitions********************************************************************************************************************/
+
+typedef struct Tile
+{
+	Chip8* chip;			//owned by one emulation thread
+	uint32_t publishedVersion;	//chip->vramVersion of the last publish
+	uint64_t rows[TILE_BUFFERS][32];	//packed screens (Chip8::packRows)
+	uint8_t back;			//emulation thread
+	atomic<uint8_t> ready;	//last published, index | TILE_FRESH
+	uint8_t front;			//render thread
+} Tile;
+
+/**Global Variables*********************************************************************************************************************/
+
+vector<Tile> tiles;
+vector<atomic<uint64_t>> tileDirty;	//bit per tile published since the render thread last looked
+atomic<bool> quit(false);
+
+SDL_Window* window = NULL;
+SDL_Renderer* renderer = NULL;
+SDL_Texture* atlas = NULL;
+int columns, tileScale, tileWidth, tileHeight, atlasWidth, atlasHeight;
+uint32_t* tilePixels = NULL;	//one rasterized tile before upload
+
+
+//emulation thread side, only called when vram changed since the last publish
+void publishTile(size_t index)
+{
+	Tile& tile = tiles[index];
+	tile.chip->packRows(tile.rows[tile.back]);
+	tile.publishedVersion = tile.chip->vramVersion;
+	uint8_t previous = tile.ready.exchange(tile.back | TILE_FRESH, memory_order_acq_rel);
+	tile.back = previous & TILE_INDEX;
+	tileDirty[index >> 6].fetch_or(1ull << (index & 63), memory_order_release);
+}
+
+
+//machines first, first + step, ... one frame each per WALL_FRAME_RATE tick
+void runMachines(size_t first, size_t step)
+{
+	chrono::steady_clock::duration period = chrono::microseconds(1000000 / WALL_FRAME_RATE);
+	chrono::steady_clock::time_point next = chrono::steady_clock::now();
+	while (!quit)
+	{
+		for (size_t i = first; i < tiles.size(); i += step)
+		{
+			tiles[i].chip->runFrame(WALL_CYCLES);
+			if (tiles[i].chip->vramVersion != tiles[i].publishedVersion) publishTile(i);
+		}
+		next += period;
+		chrono::steady_clock::time_point now = chrono::steady_clock::now();
+		if (next + period < now) next = now; //too many machines for this thread, run slower instead of catching up
+		this_thread::sleep_until(next);
+	}
+}
+
+
+SDL_Rect tileRect(size_t index)
+{
+	SDL_Rect rect = { WALL_GAP + (int)(index % columns) * (tileWidth + WALL_GAP), WALL_GAP + (int)(index / columns) * (tileHeight + WALL_GAP), tileWidth, tileHeight };
+	return rect;
+}
+
+
+//render thread: upload dirty tiles (all of them after the atlas was created), returns tiles uploaded
+int uploadTiles(bool all)
+{
+	int uploaded = 0;
+	for (size_t word = 0; word < tileDirty.size(); ++word)
+	{
+		uint64_t bits = tileDirty[word].exchange(0, memory_order_acquire);
+		if (all) bits = ~0ull;
+		for (; bits; bits &= bits - 1)
+		{
+			size_t index = word * 64 + lowestBit64(bits);
+			if (index >= tiles.size()) break;
+			Tile& tile = tiles[index];
+			if (tile.ready.load(memory_order_relaxed) & TILE_FRESH) tile.front = tile.ready.exchange(tile.front, memory_order_acq_rel) & TILE_INDEX;
+			else if (!all) continue; //published twice, taken with the first bit
+
+			rasterize(tile.rows[tile.front], tilePixels, tileWidth, tileScale, FILTER_NONE, PIXEL_ON, PIXEL_OFF);
+			SDL_Rect rect = tileRect(index);
+			SDL_UpdateTexture(atlas, &rect, tilePixels, tileWidth * 4);
+			uploaded++;
+		}
+	}
+	return uploaded;
+}
+
+
+//atlas texture with gap color everywhere, tiles are uploaded after
+bool createAtlas()
+{
+	if (atlas) SDL_DestroyTexture(atlas);
+	//static texture: partial updates (SDL_UpdateTexture with a rect) keep the rest of it
+	atlas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, atlasWidth, atlasHeight);
+	if (!atlas)
+	{
+		printf("could not create %dx%d atlas: %s\n", atlasWidth, atlasHeight, SDL_GetError());
+		return false;
+	}
+	vector<uint32_t> background((size_t)atlasWidth * atlasHeight, WALL_GAP_COLOR);
+	SDL_UpdateTexture(atlas, NULL, background.data(), atlasWidth * 4);
+	return true;
+}
+
+
+//whole atlas in the window, aspect kept
+void present()
+{
+	int width, height;
+	SDL_GetRendererOutputSize(renderer, &width, &height);
+	SDL_Rect fit = { 0, 0, width, (int)((long long)width * atlasHeight / atlasWidth) };
+	if (fit.h > height) fit = { 0, 0, (int)((long long)height * atlasWidth / atlasHeight), height };
+	fit.x = (width - fit.w) / 2;
+	fit.y = (height - fit.h) / 2;
+
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+	SDL_RenderClear(renderer);
+	SDL_RenderCopy(renderer, atlas, NULL, &fit);
+	SDL_RenderPresent(renderer);
+}
+
+
+int main(int argc, char* argv[])
+{
+	int count = 0, mode = 0, threads = (int)thread::hardware_concurrency(), scale = WALL_SCALE;
+	vector<const char*> roms;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!strcmp(argv[i], "--count") && i + 1 < argc) count = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--mode") && i + 1 < argc) mode = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--threads") && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "--scale") && i + 1 < argc) scale = atoi(argv[++i]);
+		else roms.push_back(argv[i]);
+	}
+	if (roms.empty())
+	{
+		printf("usage: wall [--count n] [--mode m] [--threads t] [--scale s] <rom> [rom ...]\n");
+		return 1;
+	}
+	if (count < 1) count = (int)roms.size();
+	if (scale < 1) scale = 1;
+
+	//one ram image and mode per rom, machines share its pages until they write them
+	vector<Memory*> images(roms.size());
+	vector<uint8_t> modes(roms.size());
+	for (size_t r = 0; r < roms.size(); ++r)
+	{
+		FILE* file = fopen(roms[r], "rb");
+		if (!file)
+		{
+			printf("could not open %s\n", roms[r]);
+			return 1;
+		}
+		uint8_t rom[MAX_ROM_SIZE];
+		size_t size = fread(rom, 1, sizeof(rom), file);
+		fclose(file);
+
+		bool cached;
+		modes[r] = mode ? (uint8_t)mode : autoMode(rom, size, &cached);
+		Chip8 loader;
+		loader.reset(rom, size);
+		images[r] = new Memory(loader.ram);
+	}
+
+	tiles = vector<Tile>(count);
+	tileDirty = vector<atomic<uint64_t>>((count + 63) / 64);
+	for (int i = 0; i < count; ++i)
+	{
+		Tile& tile = tiles[i];
+		tile.chip = new Chip8();
+		tile.chip->mode = modes[i % roms.size()];
+		tile.chip->reset(*images[i % roms.size()]);
+		tile.chip->random += (uint32_t)i * 0x9E3779B9u; //copies of one rom drift apart (CXNN)
+		if (!tile.chip->random) tile.chip->random = 1;
+		tile.chip->packRows(tile.rows[1]); //blank screen until the first publish
+		tile.publishedVersion = tile.chip->vramVersion;
+		tile.back = 0;
+		tile.ready = 1;
+		tile.front = 2;
+	}
+
+	if (SDL_Init(SDL_INIT_VIDEO))
+	{
+		printf("SDL failed to initialize : %s\n", SDL_GetError());
+		return 1;
+	}
+	window = SDL_CreateWindow("Chip8 wall", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 1280, 720, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+	renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+
+	//grid about as wide as high in tiles (2:1 overall, like one screen), scale down until the gpu takes the atlas
+	columns = (int)ceil(sqrt((double)count));
+	int rows = (count + columns - 1) / columns;
+	SDL_RendererInfo info;
+	int maxSize = SDL_GetRendererInfo(renderer, &info) == 0 && info.max_texture_width > 0 ? min(info.max_texture_width, info.max_texture_height) : 0;
+	for (tileScale = scale;; --tileScale)
+	{
+		tileWidth = CHIP8_DISPLAY_WIDTH * tileScale;
+		tileHeight = CHIP8_DISPLAY_HEIGHT * tileScale;
+		atlasWidth = WALL_GAP + columns * (tileWidth + WALL_GAP);
+		atlasHeight = WALL_GAP + rows * (tileHeight + WALL_GAP);
+		if (!maxSize || (atlasWidth <= maxSize && atlasHeight <= maxSize) || tileScale == 1) break;
+	}
+	tilePixels = new uint32_t[tileWidth * tileHeight];
+	if (!createAtlas()) return 1;
+	uploadTiles(true);
+
+	if (threads < 1) threads = 1;
+	if (threads > count) threads = count;
+	vector<thread> workers;
+	for (int t = 0; t < threads; ++t) workers.push_back(thread(runMachines, (size_t)t, (size_t)threads));
+	printf("%d machines, %d roms, %d threads, %dx%d tiles of %dx%d, atlas %dx%d\n", count, (int)roms.size(), threads, columns, rows, tileWidth, tileHeight, atlasWidth, atlasHeight);
+
+	//render thread: upload what changed, one present per refresh (vsync), nothing when nothing changed
+	uint64_t presents = 0, uploads = 0;
+	bool redraw = true;
+	SDL_Event e;
+	while (!quit)
+	{
+		bool lost = false;
+		while (SDL_PollEvent(&e) != 0)
+		{
+			if (e.type == SDL_QUIT || (e.type == SDL_KEYDOWN && e.key.keysym.scancode == SDL_SCANCODE_ESCAPE))
+			{
+				quit = true;
+				break;
+			}
+			else if (e.type == SDL_WINDOWEVENT) redraw = true;
+			else if (e.type == SDL_RENDER_DEVICE_RESET) lost = true; //textures are gone
+		}
+		if (lost && !createAtlas()) quit = true;
+		if (quit) break;
+
+		int uploaded = uploadTiles(lost);
+		if (uploaded || redraw)
+		{
+			present();
+			presents++;
+			uploads += uploaded;
+			redraw = false;
+		}
+		else SDL_Delay(1);
+	}
+
+	for (size_t t = 0; t < workers.size(); ++t) workers[t].join();
+	if (presents) printf("%llu presents, %.1f tiles uploaded per present (%.1f%% of the wall)\n", (unsigned long long)presents, (double)uploads / presents, uploads * 100.0 / presents / count);
+
+	for (size_t i = 0; i < tiles.size(); ++i) delete tiles[i].chip;
+	for (size_t r = 0; r < images.size(); ++r) delete images[r];
+	delete[] tilePixels;
+	SDL_DestroyTexture(atlas);
+	SDL_DestroyRenderer(renderer);
+	SDL_DestroyWindow(window);
+	SDL_Quit();
+	return 0;
+}